@@ -0,0 +1,36 @@
+# -*- coding: utf-8 -*-
+# Measures how long a destination is unreachable while routing converges.
+# Pings the destination every INTERVAL seconds for DURATION seconds; the
+# failover time is the longest run of lost probes once it first answered.
+#
+# Usage: python convergence.py <ip> <duration> [interval]
+import re
+import sys
+import subprocess
+
+
+def measure(ip, duration, interval):
+    process = subprocess.Popen("ping -n -i %s -w %s %s" % (interval, duration, ip),
+                               shell=True, stdout=subprocess.PIPE)
+    a, b = process.communicate()
+    seqs = [int(m) for m in re.findall(r'icmp_seq=(\d+) ttl=', a)]
+    if not seqs:
+        return None, 0, 0
+    sent = int(float(duration) / float(interval))
+    gap = 0
+    for i in range(1, len(seqs)):
+        gap = max(gap, seqs[i] - seqs[i-1] - 1)
+    # probes lost at the end, if it never came back
+    gap = max(gap, sent - seqs[-1])
+    return gap * float(interval) * 1000, sent - len(seqs), sent
+
+
+if __name__ == '__main__':
+    ip = sys.argv[1]
+    duration = sys.argv[2]
+    interval = sys.argv[3] if len(sys.argv) > 3 else '0.05'
+    outage, lost, sent = measure(ip, duration, interval)
+    if outage is None:
+        print '%s: unreachable' % ip
+    else:
+        print '%s: outage %d ms (%d of %d probes lost)' % (ip, outage, lost, sent)
@@ -0,0 +1,20 @@
+sh echo 'Info: run once with the routers started by run_sr.sh ... rip, once with ... pwospf, and compare'
+sh echo 'Info: failover of client -> server1 when router1-eth2 goes down'
+client python convergence.py 192.168.2.200 15 > /tmp/convergence.server1 &
+sh sleep 3
+router1 ifconfig router1-eth2 down
+sh echo 'Info: router1-eth2 down'
+sh sleep 13
+sh cat /tmp/convergence.server1
+router1 ifconfig router1-eth2 up
+sh echo 'Info: router1-eth2 up'
+sh sleep 10
+sh echo 'Info: failover of client -> server2 when router3 stops answering on router1-eth3'
+client python convergence.py 172.24.3.30 30 > /tmp/convergence.server2 &
+sh sleep 3
+router3 ifconfig router3-eth1 down
+sh echo 'Info: router3-eth1 down'
+sh sleep 28
+sh cat /tmp/convergence.server2
+router3 ifconfig router3-eth1 up
+sh echo 'Info: router3-eth1 up'
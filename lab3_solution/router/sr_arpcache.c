@@ -47,6 +47,47 @@ void send_unreachable_to_queued(struct sr_instance * sr, struct sr_arpreq * req)
 }
 
 
+/*
+  Sends the ARP request for req out of the interface the route selected, or
+  gives up once it has gone unanswered 5 times. The caller holds the cache
+  lock, since req may be unlinked here. A request given up on is moved to
+  cache->expired: its ICMP errors are sent and its frames freed by
+  sr_arpcache_timeout() after the lock is dropped.
+*/
+void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req) {
+    time_t now = time(0);
+
+    /* Retransmissions are paced at one per second per request */
+    if (req->times_sent > 0 && difftime(now, req->sent) < 1.0)
+        return;
+
+    if (req->times_sent >= 5) {
+        struct sr_arpreq **pp;
+        /*Hold the IP as unresolvable so new packets are not queued again*/
+        sr_arpcache_insert_negative(&sr->cache, req->ip);
+        /*Unlink this arp request; its queued packets are answered with
+        DEST_HOST_UNREACHABlE once the cache lock is released*/
+        for (pp = &(sr->cache.requests); *pp != NULL; pp = &((*pp)->next)) {
+            if (*pp == req) {
+                *pp = req->next;
+                break;
+            }
+        }
+        req->next = sr->cache.expired;
+        sr->cache.expired = req;
+        return;
+    }
+
+    struct sr_if *iface = sr_get_interface(sr, req->iface);
+    if (iface) {
+        send_arp_req(sr, iface, req->ip, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t));
+        sr->cache.reqs_sent++;
+    }
+    /*Update the times_sent and current send time*/
+    req->sent = now;
+    req->times_sent++;
+}
+
 /*This function should be implemented in checkpoint 3. 
 The logic is very simple. 
 For each ARP request in the ARP cache, checking whether the time between 
@@ -56,39 +97,14 @@ If not larger than the 1 second, just return
 void sr_arpcache_sweepreqs(struct sr_instance *sr) {
     /* Lab4: Fill your code here */
     /*For each ARP request in the ARP cache,*/
-
-    /*printf("sr_arpcache_sweepreqs\n");*/
     struct sr_arpreq * current = sr->cache.requests;
-	struct sr_arpreq * next;
-	if (current) next = current->next;
-	while (current != NULL) {
-		if (difftime(time(0), current->sent > 1)) {
-            /*Otherwise, check whether this arp request has been sent for 5 or more times, if so*/
-            if (current->times_sent >= 5) {
-                /*For each packet queueing in this arp request’s queue, 
-                send a DEST_HOST_UNREACHABlE back to the sender*/
-                send_unreachable_to_queued(sr, current);
-                /*Destroy this arp request */
-                sr_arpreq_destroy(&sr->cache, current);
-            }
-            else {
-                struct sr_if* iface = sr->if_list;
-                while(iface != NULL){
-                    int length = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
-                    send_arp_req(sr,iface,current->ip, length);
-                    /*Update the times_sent and current send time*/
-                    current -> sent = time(0);
-                    current -> times_sent++;
-                    iface = iface->next;
-                }
-		    }
-	    }
-        /* If not larger than the 1 second, just return (go to next)*/
-		current = next;
-		if (current) next = current->next;
-
-	}
-    
+    struct sr_arpreq * next;
+    while (current != NULL) {
+        /* handle_arpreq may destroy current, so grab next first */
+        next = current->next;
+        handle_arpreq(sr, current);
+        current = next;
+    }
 }
 
 /* You should not need to touch the rest of this code. */
@@ -119,6 +135,124 @@ struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
     return copy;
 }
 
+/* Marks this IP as unresolvable for cache->neg_hold seconds. */
+void sr_arpcache_insert_negative(struct sr_arpcache *cache, uint32_t ip) {
+    if (cache->neg_hold <= 0)
+        return;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    int i, slot = -1;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->negatives[i].valid && cache->negatives[i].ip == ip) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !(cache->negatives[i].valid))
+            slot = i;
+    }
+
+    /* Table full: kick out a random entry */
+    if (slot < 0)
+        slot = rand() % SR_ARPCACHE_SZ;
+
+    cache->negatives[slot].ip = ip;
+    cache->negatives[slot].added = time(NULL);
+    cache->negatives[slot].last_icmp = 0;
+    cache->negatives[slot].valid = 1;
+
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+/* Checks whether this IP is held in the negative cache. Returns 0 if it is
+   not, 1 if the caller should answer with ICMP host unreachable, or 2 if
+   the packet should just be dropped. */
+int sr_arpcache_check_negative(struct sr_arpcache *cache, uint32_t ip) {
+    int ret = 0;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        struct sr_arpneg *neg = &(cache->negatives[i]);
+        if (neg->valid && neg->ip == ip) {
+            time_t now = time(NULL);
+            if (difftime(now, neg->last_icmp) >= SR_ARPCACHE_NEG_ICMP) {
+                neg->last_icmp = now;
+                cache->neg_answered++;
+                ret = 1;
+            }
+            else {
+                cache->neg_dropped++;
+                ret = 2;
+            }
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return ret;
+}
+
+/* Returns 1 if this IP is held in the negative cache, 0 otherwise. */
+int sr_arpcache_is_negative(struct sr_arpcache *cache, uint32_t ip) {
+    int ret = 0;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->negatives[i].valid && cache->negatives[i].ip == ip) {
+            ret = 1;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return ret;
+}
+
+/* Finds (or creates) the queued frame accounting for an interface. Called
+   with the cache lock held. */
+static struct sr_arpq_ifstat *sr_arpq_get_ifstat(struct sr_arpcache *cache,
+                                                 const char *iface)
+{
+    struct sr_arpq_ifstat *st;
+    for (st = cache->q_ifstats; st != NULL; st = st->next) {
+        if (strncmp(st->name, iface, sr_IFACE_NAMELEN) == 0)
+            return st;
+    }
+    st = (struct sr_arpq_ifstat *) calloc(1, sizeof(struct sr_arpq_ifstat));
+    strncpy(st->name, iface, sr_IFACE_NAMELEN - 1);
+    st->next = cache->q_ifstats;
+    cache->q_ifstats = st;
+    return st;
+}
+
+/* Returns 1 if len more bytes fit both the global and interface budgets. */
+static int sr_arpq_fits(struct sr_arpcache *cache, struct sr_arpq_ifstat *ifstat,
+                        unsigned int len)
+{
+    if (cache->q_max_bytes && cache->q_bytes + len > cache->q_max_bytes)
+        return 0;
+    if (cache->q_max_iface_bytes && ifstat->bytes + len > cache->q_max_iface_bytes)
+        return 0;
+    return 1;
+}
+
+/* Releases a frame's charge against the budgets. Called with the cache
+   lock held. */
+static void sr_arpq_uncharge(struct sr_arpcache *cache, struct sr_packet *pkt)
+{
+    struct sr_arpq_ifstat *ifstat = sr_arpq_get_ifstat(cache, pkt->iface);
+    ifstat->bytes -= pkt->len;
+    ifstat->packets--;
+    cache->q_bytes -= pkt->len;
+    cache->q_packets--;
+}
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
    that corresponds to this ARP request. You should free the passed *packet.
@@ -135,37 +269,64 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     
     struct sr_arpreq *req;
     for (req = cache->requests; req != NULL; req = req->next) {
-        if (req->ip == ip) {
+        if (req->ip == ip && strncmp(req->iface, iface, sr_IFACE_NAMELEN) == 0) {
             break;
         }
     }
     
-    /* If the IP wasn't found, add it */
+    /* If the (IP, interface) pair wasn't found, add it */
     if (!req) {
         req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
         req->ip = ip;
+        strncpy(req->iface, iface, sr_IFACE_NAMELEN - 1);
         req->next = cache->requests;
         cache->requests = req;
     }
     
     /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
-        
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
-        new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = NULL;
-        if (req->packets == NULL){
-            req->packets = new_pkt;
+    if (packet && packet_len) {
+        struct sr_arpq_ifstat *ifstat = sr_arpq_get_ifstat(cache, iface);
+        int fits = sr_arpq_fits(cache, ifstat, packet_len);
+
+        /* Head drop: evict the oldest frames waiting on this same next hop,
+           they are the least likely to still be useful */
+        while (!fits && cache->q_drop_policy == arpq_drop_head && req->packets) {
+            struct sr_packet *old = req->packets;
+            req->packets = old->next;
+            sr_arpq_uncharge(cache, old);
+            cache->q_dropped++;
+            free(old->buf);
+            free(old->iface);
+            free(old);
+            fits = sr_arpq_fits(cache, ifstat, packet_len);
+        }
+
+        if (!fits) {
+            cache->q_dropped++;
         }
-        else{
-            struct sr_packet *p = req->packets;
-            while(p->next != NULL)
-                p = p->next;
-            p->next = new_pkt;
+        else {
+            struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
+            
+            new_pkt->buf = (uint8_t *)malloc(packet_len);
+            memcpy(new_pkt->buf, packet, packet_len);
+            new_pkt->len = packet_len;
+            new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
+            strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
+            gettimeofday(&(new_pkt->queued), NULL);
+            new_pkt->next = NULL;
+            if (req->packets == NULL){
+                req->packets = new_pkt;
+            }
+            else{
+                struct sr_packet *p = req->packets;
+                while(p->next != NULL)
+                    p = p->next;
+                p->next = new_pkt;
+            }
+            ifstat->bytes += packet_len;
+            ifstat->packets++;
+            cache->q_bytes += packet_len;
+            cache->q_packets++;
         }
     }
     
@@ -180,13 +341,14 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip)
+                                     uint32_t ip,
+                                     const char *iface)
 {
     pthread_mutex_lock(&(cache->lock));
     
     struct sr_arpreq *req, *prev = NULL, *next = NULL; 
     for (req = cache->requests; req != NULL; req = req->next) {
-        if (req->ip == ip) {            
+        if (req->ip == ip && strncmp(req->iface, iface, sr_IFACE_NAMELEN) == 0) {
             if (prev) {
                 next = req->next;
                 prev->next = next;
@@ -202,6 +364,11 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
     }
     
     int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->negatives[i].valid && cache->negatives[i].ip == ip)
+            cache->negatives[i].valid = 0;
+    }
+
     for (i = 0; i < SR_ARPCACHE_SZ; i++) {
         if (!(cache->entries[i].valid))
             break;
@@ -220,43 +387,49 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
 }
 
 /* Frees all memory associated with this arp request entry. If this arp request
-   entry is on the arp request queue, it is removed from the queue. */
+   entry is on the arp request queue, it is removed from the queue. Only the
+   unlink and the budget accounting are done under the cache lock. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
+    struct sr_packet *pkt, *nxt;
+
+    if (!entry)
+        return;
+
     pthread_mutex_lock(&(cache->lock));
     
-    if (entry) {
-        struct sr_arpreq *req, *prev = NULL, *next = NULL; 
-        for (req = cache->requests; req != NULL; req = req->next) {
-            if (req == entry) {                
-                if (prev) {
-                    next = req->next;
-                    prev->next = next;
-                } 
-                else {
-                    next = req->next;
-                    cache->requests = next;
-                }
-                
-                break;
+    struct sr_arpreq *req, *prev = NULL, *next = NULL; 
+    for (req = cache->requests; req != NULL; req = req->next) {
+        if (req == entry) {                
+            if (prev) {
+                next = req->next;
+                prev->next = next;
+            } 
+            else {
+                next = req->next;
+                cache->requests = next;
             }
-            prev = req;
-        }
-        
-        struct sr_packet *pkt, *nxt;
-        
-        for (pkt = entry->packets; pkt; pkt = nxt) {
-            nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+            
+            break;
         }
-        
-        free(entry);
+        prev = req;
+    }
+    
+    for (pkt = entry->packets; pkt; pkt = pkt->next) {
+        sr_arpq_uncharge(cache, pkt);
     }
     
     pthread_mutex_unlock(&(cache->lock));
+
+    for (pkt = entry->packets; pkt; pkt = nxt) {
+        nxt = pkt->next;
+        if (pkt->buf)
+            free(pkt->buf);
+        if (pkt->iface)
+            free(pkt->iface);
+        free(pkt);
+    }
+    
+    free(entry);
 }
 
 /* Prints out the ARP table. */
@@ -274,6 +447,40 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\n");
 }
 
+/* Prints out the ARP request counters and queued frame gauges. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+
+    /* Each request queues in arrival order, so its head is its oldest frame */
+    struct timeval now;
+    long oldest_ms = 0;
+    struct sr_arpreq *req;
+    gettimeofday(&now, NULL);
+    for (req = cache->requests; req != NULL; req = req->next) {
+        if (req->packets) {
+            long age = (now.tv_sec - req->packets->queued.tv_sec) * 1000 +
+                       (now.tv_usec - req->packets->queued.tv_usec) / 1000;
+            if (age > oldest_ms)
+                oldest_ms = age;
+        }
+    }
+
+    printf("ARP requests sent: %lu, suppressed: %lu\n",
+           cache->reqs_sent, cache->reqs_suppressed);
+    printf("ARP negative hits answered: %lu, dropped: %lu\n",
+           cache->neg_answered, cache->neg_dropped);
+    printf("ARP queue: %lu bytes, %lu packets, oldest %ld ms, %lu dropped over budget\n",
+           cache->q_bytes, cache->q_packets, oldest_ms, cache->q_dropped);
+
+    struct sr_arpq_ifstat *st;
+    for (st = cache->q_ifstats; st != NULL; st = st->next) {
+        printf("ARP queue %s: %lu bytes, %lu packets\n",
+               st->name, st->bytes, st->packets);
+    }
+
+    pthread_mutex_unlock(&(cache->lock));
+}
+
 /* Initialize table + table lock. Returns 0 on success. */
 int sr_arpcache_init(struct sr_arpcache *cache) {  
     /* Seed RNG to kick out a random entry if all entries full. */
@@ -281,7 +488,21 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
     
     /* Invalidate all entries */
     memset(cache->entries, 0, sizeof(cache->entries));
+    memset(cache->negatives, 0, sizeof(cache->negatives));
+    cache->neg_hold = SR_ARPCACHE_NEG_TO;
     cache->requests = NULL;
+    cache->expired = NULL;
+    cache->reqs_sent = 0;
+    cache->reqs_suppressed = 0;
+    cache->neg_answered = 0;
+    cache->neg_dropped = 0;
+    cache->q_bytes = 0;
+    cache->q_packets = 0;
+    cache->q_dropped = 0;
+    cache->q_max_bytes = SR_ARPQ_MAX_BYTES;
+    cache->q_max_iface_bytes = SR_ARPQ_MAX_IFACE_BYTES;
+    cache->q_drop_policy = arpq_drop_tail;
+    cache->q_ifstats = NULL;
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
@@ -297,7 +518,8 @@ int sr_arpcache_destroy(struct sr_arpcache *cache) {
 }
 
 /* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+   more than SR_ARPCACHE_TO seconds ago, and negative entries older than
+   the configured hold time. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
     struct sr_arpcache *cache = &(sr->cache);
@@ -314,11 +536,26 @@ void *sr_arpcache_timeout(void *sr_ptr) {
             if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
                 cache->entries[i].valid = 0;
             }
+            if ((cache->negatives[i].valid) && (difftime(curtime,cache->negatives[i].added) > cache->neg_hold)) {
+                cache->negatives[i].valid = 0;
+            }
         }
         
         sr_arpcache_sweepreqs(sr);
 
+        struct sr_arpreq *expired = cache->expired;
+        cache->expired = NULL;
+
         pthread_mutex_unlock(&(cache->lock));
+
+        /* For each packet queueing on an expired request, send a
+           DEST_HOST_UNREACHABlE back to the sender, then destroy it */
+        while (expired != NULL) {
+            struct sr_arpreq *next = expired->next;
+            send_unreachable_to_queued(sr, expired);
+            sr_arpreq_destroy(cache, expired);
+            expired = next;
+        }
     }
     
     return NULL;
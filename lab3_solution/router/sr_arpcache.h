@@ -68,19 +68,42 @@
 
 #include <inttypes.h>
 #include <time.h>
+#include <sys/time.h>
 #include <pthread.h>
 #include "sr_if.h"
 
 #define SR_ARPCACHE_SZ    100  
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_NEG_TO   20.0 /* Default hold time for unresolvable IPs */
+#define SR_ARPCACHE_NEG_ICMP 1.0  /* Min seconds between ICMPs per failed IP */
+
+/* Budget for frame bytes parked on ARP requests */
+#define SR_ARPQ_MAX_BYTES        (1024 * 1024)
+#define SR_ARPQ_MAX_IFACE_BYTES  (256 * 1024)
+
+/* What to do with a packet that does not fit the budget */
+enum sr_arpq_drop_policy {
+    arpq_drop_tail = 0,         /* Drop the arriving packet */
+    arpq_drop_head = 1          /* Evict the oldest packets waiting on the
+                                   same request to make room */
+};
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
     char *iface;                /* The outgoing interface */
+    struct timeval queued;      /* When the frame was parked on its request */
     struct sr_packet *next;
 };
 
+/* Queued frame accounting for one egress interface */
+struct sr_arpq_ifstat {
+    char name[sr_IFACE_NAMELEN];
+    unsigned long bytes;
+    unsigned long packets;
+    struct sr_arpq_ifstat *next;
+};
+
 struct sr_arpentry {
     unsigned char mac[6]; 
     uint32_t ip;                /* IP addr in network byte order */
@@ -88,8 +111,18 @@ struct sr_arpentry {
     int valid;
 };
 
+/* Negative entry: an IP that went unanswered after 5 ARP requests. While
+   it is held, packets to it are answered or dropped without queueing. */
+struct sr_arpneg {
+    uint32_t ip;                /* IP addr in network byte order */
+    time_t added;
+    time_t last_icmp;           /* Last time we answered a packet for it */
+    int valid;
+};
+
 struct sr_arpreq {
     uint32_t ip;
+    char iface[sr_IFACE_NAMELEN]; /* Egress interface the request goes out on */
     time_t sent;                /* Last time this ARP request was sent. You 
                                    should update this. If the ARP request was 
                                    never sent, will be 0. */
@@ -101,7 +134,21 @@ struct sr_arpreq {
 
 struct sr_arpcache {
     struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arpneg negatives[SR_ARPCACHE_SZ];
+    double neg_hold;               /* Seconds to hold a negative entry, 0 = off */
     struct sr_arpreq *requests;
+    struct sr_arpreq *expired;     /* Given up on, answered and freed unlocked */
+    unsigned long reqs_sent;       /* ARP requests put on the wire */
+    unsigned long reqs_suppressed; /* Misses folded into an outstanding request */
+    unsigned long neg_answered;    /* Packets to a failed IP answered with ICMP */
+    unsigned long neg_dropped;     /* Packets to a failed IP dropped silently */
+    unsigned long q_bytes;         /* Frame bytes parked on requests */
+    unsigned long q_packets;       /* Frames parked on requests */
+    unsigned long q_dropped;       /* Frames dropped for exceeding the budget */
+    unsigned long q_max_bytes;     /* Global budget, 0 = unlimited */
+    unsigned long q_max_iface_bytes; /* Per-interface budget, 0 = unlimited */
+    enum sr_arpq_drop_policy q_drop_policy;
+    struct sr_arpq_ifstat *q_ifstats;
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
 };
@@ -110,11 +157,16 @@ struct sr_arpcache {
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
 
-/* Adds an ARP request to the ARP request queue. If the request is already on
+/* Adds an ARP request to the ARP request queue. Requests are keyed on the
+   (next-hop IP, egress interface) pair. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
    that corresponds to this ARP request. The packet argument should not be
    freed by the caller.
 
+   The copy is charged against the global and per-interface budgets; if it
+   does not fit, cache->q_drop_policy decides whether it or the oldest frames
+   on the same request are dropped.
+
    A pointer to the ARP request is returned; it should be freed. The caller
    can remove the ARP request from the queue by calling sr_arpreq_destroy. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
@@ -124,20 +176,45 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          char *iface);
 
 /* This method performs two functions:
-   1) Looks up this IP in the request queue. If it is found, returns a pointer
-      to the sr_arpreq with this IP. Otherwise, returns NULL.
-   2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
+   1) Looks up this IP on the given interface in the request queue. If it is
+      found, returns a pointer to the sr_arpreq with this IP. Otherwise,
+      returns NULL.
+   2) Inserts this IP to MAC mapping in the cache, and marks it valid.
+   Any negative entry for this IP is cleared. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip);
+                                     uint32_t ip,
+                                     const char *iface);
 
 /* Frees all memory associated with this arp request entry. If this arp request
-   entry is on the arp request queue, it is removed from the queue. */
+   entry is on the arp request queue, it is removed from the queue. Only the
+   unlink and accounting happen under the cache lock. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
+/* Marks this IP as unresolvable for cache->neg_hold seconds. */
+void sr_arpcache_insert_negative(struct sr_arpcache *cache, uint32_t ip);
+
+/* Checks whether this IP is held in the negative cache. Returns 0 if it is
+   not, 1 if it is and the caller should answer with ICMP host unreachable,
+   or 2 if it is and the packet should be dropped (answer rate limited). */
+int sr_arpcache_check_negative(struct sr_arpcache *cache, uint32_t ip);
+
+/* Returns 1 if this IP is held in the negative cache, 0 otherwise. Unlike
+   sr_arpcache_check_negative, this does not count as a hit. */
+int sr_arpcache_is_negative(struct sr_arpcache *cache, uint32_t ip);
+
+/* Sends the ARP request for req on its egress interface if it is due, or
+   gives up on it after 5 attempts, moving it to cache->expired for the
+   sweep thread to answer and free once the lock is dropped. Must be called
+   with the cache lock held; req may be unlinked. */
+void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req);
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Prints out the ARP request counters and queued frame gauges. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache);
+
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
    a destructor, and a cleanup thread times out cache entries every 15
@@ -0,0 +1,478 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bfd.c
+ *
+ * Description:
+ *
+ * BFD-style liveness detection: sessions, their three-way handshake, the
+ * timing wheel driving transmission and detection, and the hand-off of a
+ * lost neighbor to the routing protocol
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_bfd.h"
+#include "sr_pwospf.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+#include "sr_router.h"
+
+/* A session lost while the lock was held, reported once it is released */
+struct sr_bfd_down
+{
+    uint32_t ip;
+    char interface[sr_IFACE_NAMELEN];
+    struct sr_bfd_down* next;
+};
+
+static const char *sr_bfd_state_names[] = { "admin down", "down", "init", "up" };
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_init()
+ * @brief function sets up the liveness detection and starts its timer
+ * thread
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_bfd_init(struct sr_instance *sr) {
+  struct sr_bfd *bfd = (struct sr_bfd *)calloc(1, sizeof(struct sr_bfd));
+  pthread_t thread;
+
+  assert(bfd);
+  pthread_mutex_init(&(bfd->lock), NULL);
+  bfd->tick = sr_now_ms() / SR_BFD_TICK_MS;
+  sr->bfd = bfd;
+
+  pthread_create(&thread, &(sr->rt_attr), sr_bfd_timeout, sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_find()
+ * @brief function finds the session with a neighbor
+ * @param bfd: the liveness detection state
+ * @param ip: the neighbor
+ * @param if_name: interface it is reached on
+ * @return: the session, NULL if there is none
+ *---------------------------------------------------------------------*/
+static struct sr_bfd_session* sr_bfd_find(struct sr_bfd *bfd, uint32_t ip, const char *if_name) {
+  struct sr_bfd_session* s;
+  for(s = bfd->hash[ntohl(ip) % SR_BFD_HASH_SIZE]; s; s = s->hash_next){
+    if(s->ip == ip && strcmp(s->interface, if_name) == 0){
+      return s;
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_file()
+ * @brief function (re)files a session in the timing wheel under its next
+ * event, the next transmission or the end of its detection time. A time
+ * already passed is filed under the next tick. Called with the lock held.
+ * @param bfd: the liveness detection state
+ * @param s: the session
+ *---------------------------------------------------------------------*/
+static void sr_bfd_file(struct sr_bfd *bfd, struct sr_bfd_session *s) {
+  uint64_t tick;
+
+  if(s->wheel_pprev != NULL){
+    *(s->wheel_pprev) = s->wheel_next;
+    if(s->wheel_next != NULL){
+      s->wheel_next->wheel_pprev = s->wheel_pprev;
+    }
+  }
+  s->due_ms = s->next_tx_ms;
+  if(s->detect_ms != 0 && s->detect_ms < s->due_ms){
+    s->due_ms = s->detect_ms;
+  }
+  tick = s->due_ms / SR_BFD_TICK_MS;
+  if(tick <= bfd->tick){
+    tick = bfd->tick + 1;
+  }
+  struct sr_bfd_session** slot = &(bfd->wheel[tick % SR_BFD_WHEEL_SLOTS]);
+  s->wheel_next = *slot;
+  if(*slot != NULL){
+    (*slot)->wheel_pprev = &(s->wheel_next);
+  }
+  s->wheel_pprev = slot;
+  *slot = s;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_tx_interval()
+ * @brief function picks the time to the next control packet: our interval,
+ * or the slower one the peer asks for, once the session is up, and
+ * SR_BFD_SLOW_TX_MS before. It is jittered down by up to 25% so the
+ * sessions of a router do not synchronize.
+ * @param sr: pointer to simple router state.
+ * @param s: the session
+ *---------------------------------------------------------------------*/
+static unsigned int sr_bfd_tx_interval(struct sr_instance *sr, struct sr_bfd_session *s) {
+  unsigned int interval = SR_BFD_SLOW_TX_MS;
+  if(s->state == BFD_STATE_UP){
+    interval = sr->bfd_interval_ms;
+    if(s->remote_min_rx_us / 1000 > interval){
+      interval = s->remote_min_rx_us / 1000;
+    }
+  }
+  return interval - rand() % (interval / 4 + 1);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_detect_time()
+ * @brief function computes how long the peer may stay silent: its detect
+ * multiplier times the slower of its interval and ours
+ * @param sr: pointer to simple router state.
+ * @param s: the session
+ *---------------------------------------------------------------------*/
+static unsigned int sr_bfd_detect_time(struct sr_instance *sr, struct sr_bfd_session *s) {
+  unsigned int interval = sr->bfd_interval_ms;
+  if(s->remote_min_tx_us / 1000 > interval){
+    interval = s->remote_min_tx_us / 1000;
+  }
+  return s->remote_mult * interval;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_set_state()
+ * @brief function moves a session to a new state. A session leaving up is
+ * queued to be reported to the routing protocol. Called with the lock
+ * held.
+ * @param s: the session
+ * @param state: BFD_STATE_*
+ * @param diag: BFD_DIAG_*, kept when going down
+ * @param downs: queue of lost sessions
+ *---------------------------------------------------------------------*/
+static void sr_bfd_set_state(struct sr_bfd_session *s, uint8_t state, uint8_t diag,
+                             struct sr_bfd_down **downs) {
+  if(s->state == state){
+    return;
+  }
+  if(state == BFD_STATE_UP){
+    s->ups++;
+  }
+  else if(s->state == BFD_STATE_UP){
+    struct sr_bfd_down* down = (struct sr_bfd_down*)calloc(1, sizeof(struct sr_bfd_down));
+    assert(down);
+    down->ip = s->ip;
+    memcpy(down->interface, s->interface, sr_IFACE_NAMELEN);
+    down->next = *downs;
+    *downs = down;
+    s->downs++;
+  }
+  if(state == BFD_STATE_DOWN){
+    s->diag = diag;
+    s->your_disc = 0;
+    s->detect_ms = 0;
+  }
+  s->state = state;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_report()
+ * @brief function hands the lost sessions to the routing protocol, which
+ * withdraws the routes through the neighbors right away, and frees them
+ * @param sr: pointer to simple router state.
+ * @param downs: queue of lost sessions
+ *---------------------------------------------------------------------*/
+static void sr_bfd_report(struct sr_instance *sr, struct sr_bfd_down *downs) {
+  while(downs){
+    struct sr_bfd_down* next = downs->next;
+    struct in_addr addr;
+    addr.s_addr = downs->ip;
+    printf("BFD session with %s on %s down\n", inet_ntoa(addr), downs->interface);
+    if(sr->routing_protocol == routing_pwospf){
+      sr_pwospf_nbr_down(sr, downs->ip, downs->interface);
+    }
+    else{
+      sr_rip_nbr_down(sr, downs->ip, downs->interface);
+    }
+    free(downs);
+    downs = next;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_add_session()
+ * @brief function opens a session with a neighbor the routing protocol
+ * heard from, if there is none yet
+ * @param sr: pointer to simple router state.
+ * @param ip: the neighbor
+ * @param if_name: interface it is reached on
+ *---------------------------------------------------------------------*/
+void sr_bfd_add_session(struct sr_instance *sr, uint32_t ip, const char *if_name) {
+  struct sr_bfd *bfd = sr->bfd;
+  struct sr_bfd_session* s;
+
+  if(bfd == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(bfd->lock));
+  if(sr_bfd_find(bfd, ip, if_name) == NULL){
+    s = (struct sr_bfd_session*)calloc(1, sizeof(struct sr_bfd_session));
+    assert(s);
+    s->ip = ip;
+    strncpy(s->interface, if_name, sr_IFACE_NAMELEN - 1);
+    s->state = BFD_STATE_DOWN;
+    s->my_disc = (uint32_t)rand() + 1;
+    s->next_tx_ms = sr_now_ms();
+    s->hash_next = bfd->hash[ntohl(ip) % SR_BFD_HASH_SIZE];
+    bfd->hash[ntohl(ip) % SR_BFD_HASH_SIZE] = s;
+    s->next = bfd->sessions;
+    bfd->sessions = s;
+    bfd->num_sessions++;
+    sr_bfd_file(bfd, s);
+  }
+  pthread_mutex_unlock(&(bfd->lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_packet()
+ * @brief function builds the control packet of a session. It is sent to
+ * the neighbor's address in a broadcast frame, so it needs no ARP entry,
+ * with a TTL of 255 the receiver checks. Called with the lock held.
+ * @param sr: pointer to simple router state.
+ * @param s: the session
+ * @param interface: the interface it is sent on
+ * @return: the packet
+ *---------------------------------------------------------------------*/
+static struct sr_packet* sr_bfd_packet(struct sr_instance *sr, struct sr_bfd_session *s,
+                                       struct sr_if *interface) {
+  unsigned int bfd_len = sizeof(sr_udp_hdr_t) + sizeof(sr_bfd_hdr_t);
+  struct sr_packet* pkt = (struct sr_packet*)calloc(1, sizeof(struct sr_packet));
+  assert(pkt);
+  pkt->len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + bfd_len;
+  pkt->buf = (uint8_t*)calloc(1, pkt->len);
+  assert(pkt->buf);
+  pkt->iface = interface->name;
+
+  /* 1.a Set Ethernet header */
+  sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)pkt->buf;
+  memcpy(ethernet_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
+  memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+  ethernet_hdr->ether_type = htons(ethertype_ip);
+
+  /* 1.b Set IP header */
+  sr_ip_hdr_t* ip = (sr_ip_hdr_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t));
+  ip->ip_hl = 0x5;
+  ip->ip_v  = 0x4;
+  ip->ip_tos = iptos;
+  ip->ip_len = htons((uint16_t)(sizeof(sr_ip_hdr_t) + bfd_len));
+  ip->ip_id = htons(ipid);
+  ip->ip_off = htons(ipoff);
+  ip->ip_ttl = BFD_TTL;
+  ip->ip_p = ip_protocol_udp;
+  ip->ip_src = interface->ip;
+  ip->ip_dst = s->ip;
+  ip->ip_sum = 0;
+  ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+  /* 1.c Set UDP header, no checksum */
+  sr_udp_hdr_t* udp = (sr_udp_hdr_t *)(ip + 1);
+  udp->port_src = htons(BFD_PORT);
+  udp->port_dst = htons(BFD_PORT);
+  udp->udp_len = htons((uint16_t)bfd_len);
+  udp->udp_sum = 0;
+
+  /* 1.d Set BFD control packet */
+  sr_bfd_hdr_t* ctl = (sr_bfd_hdr_t *)(udp + 1);
+  ctl->vers_diag = (BFD_V1 << 5) | s->diag;
+  ctl->state_flags = s->state << 6;
+  ctl->detect_mult = sr->bfd_detect_mult;
+  ctl->len = sizeof(sr_bfd_hdr_t);
+  ctl->my_disc = htonl(s->my_disc);
+  ctl->your_disc = htonl(s->your_disc);
+  ctl->min_tx = htonl(sr->bfd_interval_ms * 1000);
+  ctl->min_rx = htonl(sr->bfd_interval_ms * 1000);
+  ctl->min_echo_rx = 0;
+  s->sent++;
+  return pkt;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_send()
+ * @brief function sends and frees the queued packets
+ * @param sr: pointer to simple router state.
+ * @param outbox: the queue
+ *---------------------------------------------------------------------*/
+static void sr_bfd_send(struct sr_instance *sr, struct sr_packet *outbox) {
+  while(outbox){
+    struct sr_packet* next = outbox->next;
+    sr_send_packet(sr, outbox->buf, outbox->len, outbox->iface);
+    free(outbox->buf);
+    free(outbox);
+    outbox = next;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_timeout()
+ * @brief function turns the timing wheel every SR_BFD_TICK_MS. Only the
+ * sessions filed under a tick are looked at: the ones whose detection
+ * time ran out go down, the ones due to send queue a control packet, and
+ * each is filed again under its next event.
+ * @param sr_ptr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void *sr_bfd_timeout(void *sr_ptr) {
+  struct sr_instance *sr = sr_ptr;
+  struct sr_bfd *bfd = sr->bfd;
+  struct timespec ts;
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = SR_BFD_TICK_MS * 1000000;
+  while (1) {
+    struct sr_packet* outbox = NULL;
+    struct sr_bfd_down* downs = NULL;
+
+    nanosleep(&ts, NULL);
+    pthread_mutex_lock(&(bfd->lock));
+    uint64_t now = sr_now_ms();
+    uint64_t now_tick = now / SR_BFD_TICK_MS;
+    if (now_tick - bfd->tick > SR_BFD_WHEEL_SLOTS) {
+      /* overslept: one turn of the wheel still visits every slot */
+      bfd->tick = now_tick - SR_BFD_WHEEL_SLOTS;
+    }
+    while (bfd->tick < now_tick) {
+      struct sr_bfd_session* s;
+      struct sr_bfd_session* next;
+      bfd->tick++;
+      bfd->ticks++;
+      for (s = bfd->wheel[bfd->tick % SR_BFD_WHEEL_SLOTS]; s; s = next) {
+        next = s->wheel_next;
+        if (s->due_ms / SR_BFD_TICK_MS > bfd->tick) {
+          continue; /* filed for a later turn */
+        }
+        bfd->timers_fired++;
+        if (s->detect_ms != 0 && now >= s->detect_ms) {
+          bfd->expiries++;
+          sr_bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_EXPIRED, &downs);
+        }
+        if (now >= s->next_tx_ms) {
+          struct sr_if* interface = sr_get_interface(sr, s->interface);
+          if (interface != NULL && sr_obtain_interface_status(sr, s->interface) != 0) {
+            struct sr_packet* pkt = sr_bfd_packet(sr, s, interface);
+            pkt->next = outbox;
+            outbox = pkt;
+          }
+          s->next_tx_ms = now + sr_bfd_tx_interval(sr, s);
+        }
+        sr_bfd_file(bfd, s);
+      }
+    }
+    pthread_mutex_unlock(&(bfd->lock));
+
+    sr_bfd_send(sr, outbox);
+    sr_bfd_report(sr, downs);
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_handle()
+ * @brief function handles a received control packet: it restarts the
+ * session's detection time and advances the three-way handshake (down ->
+ * init -> up); a peer reporting down takes the session down with it
+ * @param sr: pointer to simple router state.
+ * @param packet: the Ethernet frame
+ * @param len: length of the IP packet in it
+ * @param if_name: interface it was received on
+ *---------------------------------------------------------------------*/
+void sr_bfd_handle(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *if_name) {
+  struct sr_bfd *bfd = sr->bfd;
+  sr_ip_hdr_t* ip = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  sr_bfd_hdr_t* ctl = (sr_bfd_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
+  struct sr_bfd_down* downs = NULL;
+  struct sr_bfd_session* s;
+  uint8_t state, remote;
+
+  if(bfd == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(bfd->lock));
+  if(len < sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t) + sizeof(sr_bfd_hdr_t) ||
+     ip->ip_ttl != BFD_TTL || (ctl->vers_diag >> 5) != BFD_V1 ||
+     ctl->len < sizeof(sr_bfd_hdr_t) || ctl->detect_mult == 0 || ctl->my_disc == 0 ||
+     (s = sr_bfd_find(bfd, ip->ip_src, if_name)) == NULL ||
+     (ctl->your_disc != 0 && ntohl(ctl->your_disc) != s->my_disc)){
+    bfd->dropped++;
+    pthread_mutex_unlock(&(bfd->lock));
+    return;
+  }
+
+  uint64_t now = sr_now_ms();
+  s->rcvd++;
+  s->your_disc = ntohl(ctl->my_disc);
+  s->remote_min_tx_us = ntohl(ctl->min_tx);
+  s->remote_min_rx_us = ntohl(ctl->min_rx);
+  s->remote_mult = ctl->detect_mult;
+
+  /* 1 State machine */
+  state = s->state;
+  remote = ctl->state_flags >> 6;
+  if(remote == BFD_STATE_ADMIN_DOWN){
+    sr_bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_NBR_DOWN, &downs);
+  }
+  else if(s->state == BFD_STATE_DOWN){
+    if(remote == BFD_STATE_DOWN){
+      sr_bfd_set_state(s, BFD_STATE_INIT, BFD_DIAG_NONE, &downs);
+    }
+    else if(remote == BFD_STATE_INIT){
+      sr_bfd_set_state(s, BFD_STATE_UP, BFD_DIAG_NONE, &downs);
+    }
+  }
+  else if(s->state == BFD_STATE_INIT){
+    if(remote == BFD_STATE_INIT || remote == BFD_STATE_UP){
+      sr_bfd_set_state(s, BFD_STATE_UP, BFD_DIAG_NONE, &downs);
+    }
+  }
+  else if(remote == BFD_STATE_DOWN){
+    sr_bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_NBR_DOWN, &downs);
+  }
+
+  /* 2 Restart the detection time; answer a state change right away */
+  if(s->state != BFD_STATE_DOWN){
+    s->detect_ms = now + sr_bfd_detect_time(sr, s);
+  }
+  if(s->state != state){
+    s->next_tx_ms = now;
+  }
+  sr_bfd_file(bfd, s);
+  pthread_mutex_unlock(&(bfd->lock));
+
+  sr_bfd_report(sr, downs);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_bfd_print_stats()
+ * @brief function prints the sessions and the liveness detection counters
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_bfd_print_stats(struct sr_instance *sr) {
+  struct sr_bfd *bfd = sr->bfd;
+  struct sr_bfd_session* s;
+
+  if(bfd == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(bfd->lock));
+  printf("BFD: %u sessions, %u ms interval x %u, %lu ticks, %lu timers fired, %lu expiries, %lu dropped\n",
+         bfd->num_sessions, sr->bfd_interval_ms, sr->bfd_detect_mult,
+         bfd->ticks, bfd->timers_fired, bfd->expiries, bfd->dropped);
+  for(s = bfd->sessions; s; s = s->next){
+    struct in_addr addr;
+    addr.s_addr = s->ip;
+    printf("  %s on %s: %s, %lu ups, %lu downs, %lu sent, %lu received\n",
+           inet_ntoa(addr), s->interface, sr_bfd_state_names[s->state],
+           s->ups, s->downs, s->sent, s->rcvd);
+  }
+  pthread_mutex_unlock(&(bfd->lock));
+}
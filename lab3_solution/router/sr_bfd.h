@@ -0,0 +1,99 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bfd.h
+ *
+ * Description:
+ *
+ * BFD-style liveness detection between adjacent routers. The routing
+ * protocol opens a session per neighbor it hears from; both ends then
+ * exchange control packets every few tens of milliseconds, and a session
+ * that stops hearing from its peer for the detection time goes down and
+ * tells the routing protocol, which withdraws the neighbor's routes at
+ * once instead of waiting for its own timeout.
+ *
+ * Sessions are filed in a timing wheel by their next event, so the timer
+ * thread only touches the sessions that are due.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_BFD_H
+#define sr_BFD_H
+
+#ifdef _DARWIN_
+#include <sys/types.h>
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+
+#define SR_BFD_INTERVAL_MS     100  /* TX interval, 0 disables BFD */
+#define SR_BFD_MIN_INTERVAL_MS 50
+#define SR_BFD_MAX_INTERVAL_MS 300
+#define SR_BFD_DETECT_MULT     3    /* intervals missed before a session goes down */
+#define SR_BFD_SLOW_TX_MS      1000 /* TX interval of a session that is not up */
+#define SR_BFD_TICK_MS         10   /* timing wheel granularity */
+#define SR_BFD_WHEEL_SLOTS     128
+#define SR_BFD_HASH_SIZE       64
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_bfd_session
+ *
+ * Session with one neighbor, identified by its address and our interface
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_bfd_session
+{
+    uint32_t ip;
+    char interface[sr_IFACE_NAMELEN];
+    uint8_t state;
+    uint8_t diag;           /* why it last went down */
+    uint32_t my_disc;
+    uint32_t your_disc;
+    uint32_t remote_min_tx_us;
+    uint32_t remote_min_rx_us;
+    uint8_t remote_mult;
+    uint64_t next_tx_ms;
+    uint64_t detect_ms;     /* when the peer is declared down, 0 - not armed */
+    uint64_t due_ms;        /* earliest of the two, its place in the wheel */
+    unsigned long ups;
+    unsigned long downs;
+    unsigned long sent;
+    unsigned long rcvd;
+    struct sr_bfd_session* wheel_next;
+    struct sr_bfd_session** wheel_pprev;
+    struct sr_bfd_session* hash_next;
+    struct sr_bfd_session* next;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_bfd
+ *
+ * State of the liveness detection
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_bfd
+{
+    pthread_mutex_t lock; /* guards everything below */
+    struct sr_bfd_session* sessions;
+    struct sr_bfd_session* hash[SR_BFD_HASH_SIZE];
+    struct sr_bfd_session* wheel[SR_BFD_WHEEL_SLOTS];
+    uint64_t tick;        /* last tick the wheel was turned to */
+    unsigned int num_sessions;
+    unsigned long ticks;
+    unsigned long timers_fired;  /* session events handled by the wheel */
+    unsigned long expiries;      /* sessions down on detection time */
+    unsigned long dropped;       /* malformed or unknown control packets */
+};
+
+void sr_bfd_init(struct sr_instance*);
+void *sr_bfd_timeout(void *);
+void sr_bfd_add_session(struct sr_instance*, uint32_t, const char *);
+void sr_bfd_handle(struct sr_instance*, uint8_t *, unsigned int, char *);
+void sr_bfd_print_stats(struct sr_instance*);
+
+#endif /* -- sr_BFD_H -- */
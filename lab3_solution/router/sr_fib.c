@@ -0,0 +1,165 @@
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+/* Prefix length of a network-order mask */
+static int sr_fib_prefix_len(uint32_t mask) {
+    uint32_t m = ntohl(mask);
+    int len = 0;
+    while (m & 0x80000000u) {
+        len++;
+        m <<= 1;
+    }
+    return len;
+}
+
+/* Longest prefix first, so the first match of a scan is the longest */
+static int sr_fib_cmp(const void *a, const void *b) {
+    const struct sr_rt *ra = a;
+    const struct sr_rt *rb = b;
+    return sr_fib_prefix_len(rb->mask.s_addr) - sr_fib_prefix_len(ra->mask.s_addr);
+}
+
+void sr_fib_init(struct sr_fib_state *fib) {
+    fib->current = NULL;
+    fib->epoch = 0;
+    fib->readers = NULL;
+    fib->retired = NULL;
+    fib->published = 0;
+    fib->reclaimed = 0;
+    pthread_mutex_init(&(fib->lock), NULL);
+}
+
+/* Free the retired versions no online reader can still hold. Called with
+   fib->lock held. */
+static void sr_fib_reclaim(struct sr_fib_state *fib) {
+    struct sr_fib_reader *reader;
+    struct sr_fib **link = &(fib->retired);
+    uint64_t min_seen = __atomic_load_n(&(fib->epoch), __ATOMIC_SEQ_CST);
+
+    for (reader = fib->readers; reader; reader = reader->next) {
+        if (__atomic_load_n(&(reader->online), __ATOMIC_SEQ_CST)) {
+            uint64_t seen = __atomic_load_n(&(reader->seen), __ATOMIC_SEQ_CST);
+            if (seen < min_seen) {
+                min_seen = seen;
+            }
+        }
+    }
+
+    while (*link) {
+        struct sr_fib *version = *link;
+        if (version->retired_at <= min_seen) {
+            *link = version->next;
+            free(version->entries);
+            free(version);
+            fib->reclaimed++;
+        }
+        else {
+            link = &(version->next);
+        }
+    }
+}
+
+void sr_fib_publish(struct sr_fib_state *fib, struct sr_rt *table, uint32_t gen) {
+    struct sr_fib *version = malloc(sizeof(struct sr_fib));
+    struct sr_fib *old;
+    struct sr_rt *rt;
+    unsigned int n = 0;
+
+    assert(version);
+    for (rt = table; rt; rt = rt->next) {
+        n++;
+    }
+    version->entries = malloc((n + 1) * sizeof(struct sr_rt));
+    assert(version->entries);
+    version->len = 0;
+    version->gen = gen;
+    version->next = NULL;
+
+    /* Copy the reachable routes and cut them loose from the mutable list */
+    for (rt = table; rt; rt = rt->next) {
+        if (rt->metric < INFINITY && !rt->damp.suppressed) {
+            version->entries[version->len] = *rt;
+            version->entries[version->len].next = NULL;
+            version->entries[version->len].hash_next = NULL;
+            version->len++;
+        }
+    }
+    qsort(version->entries, version->len, sizeof(struct sr_rt), sr_fib_cmp);
+
+    /* Publish, then retire the replaced version in the new epoch */
+    old = __atomic_exchange_n(&(fib->current), version, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&(fib->lock));
+    fib->published++;
+    if (old) {
+        old->retired_at = __atomic_add_fetch(&(fib->epoch), 1, __ATOMIC_SEQ_CST);
+        old->next = fib->retired;
+        fib->retired = old;
+    }
+    sr_fib_reclaim(fib);
+    pthread_mutex_unlock(&(fib->lock));
+}
+
+int sr_fib_is_current(struct sr_fib_state *fib, uint32_t gen) {
+    struct sr_fib *version = __atomic_load_n(&(fib->current), __ATOMIC_SEQ_CST);
+    return version && version->gen == gen;
+}
+
+struct sr_rt *sr_fib_lookup(struct sr_fib_state *fib, uint32_t addr) {
+    struct sr_fib *version = __atomic_load_n(&(fib->current), __ATOMIC_SEQ_CST);
+    unsigned int i;
+
+    if (!version) {
+        return NULL;
+    }
+    for (i = 0; i < version->len; i++) {
+        struct sr_rt *rt = &(version->entries[i]);
+        if ((addr & rt->mask.s_addr) == (rt->dest.s_addr & rt->mask.s_addr)) {
+            return rt;
+        }
+    }
+    return NULL;
+}
+
+struct sr_fib_reader *sr_fib_register_reader(struct sr_fib_state *fib) {
+    struct sr_fib_reader *reader = calloc(1, sizeof(struct sr_fib_reader));
+    assert(reader);
+
+    pthread_mutex_lock(&(fib->lock));
+    reader->next = fib->readers;
+    fib->readers = reader;
+    pthread_mutex_unlock(&(fib->lock));
+    return reader;
+}
+
+void sr_fib_online(struct sr_fib_state *fib, struct sr_fib_reader *reader) {
+    __atomic_store_n(&(reader->seen), __atomic_load_n(&(fib->epoch), __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(reader->online), 1, __ATOMIC_SEQ_CST);
+}
+
+void sr_fib_offline(struct sr_fib_reader *reader) {
+    __atomic_store_n(&(reader->online), 0, __ATOMIC_SEQ_CST);
+}
+
+void sr_fib_print_stats(struct sr_fib_state *fib) {
+    struct sr_fib *version;
+    struct sr_fib *retired;
+    unsigned long pending = 0;
+
+    pthread_mutex_lock(&(fib->lock));
+    version = __atomic_load_n(&(fib->current), __ATOMIC_SEQ_CST);
+    for (retired = fib->retired; retired; retired = retired->next) {
+        pending++;
+    }
+    printf("FIB: %u routes (generation %u), %lu published, %lu reclaimed, %lu pending reclaim\n",
+           version ? version->len : 0, version ? version->gen : 0,
+           fib->published, fib->reclaimed, pending);
+    pthread_mutex_unlock(&(fib->lock));
+}
@@ -0,0 +1,82 @@
+/* This file defines the forwarding table (FIB) read by the forwarding path.
+
+   The routing table in sr_rt.c is mutated in place by the RIP thread under
+   rt_locker. Forwarding must neither take that lock nor see a half-updated
+   route, so the forwarding path reads an immutable copy instead: an array
+   of routes sorted longest prefix first, published with an atomic pointer
+   store whenever the routing table generation (sr->rt_seq) changes.
+
+   Replaced versions are reclaimed with quiescent-state based reclamation
+   (QSBR). Every thread that reads the FIB registers a reader, and goes
+   offline at its quiescent points, where it holds no FIB pointer. The
+   forwarding thread does so while it is blocked waiting for a packet:
+
+   # forwarding thread
+   reader = sr_fib_register_reader(fib)
+   loop:
+       sr_fib_offline(reader)
+       wait for a packet
+       sr_fib_online(fib, reader)
+       rt = sr_fib_lookup(fib, dst)     -- valid until the next offline
+
+   # writer, with rt_locker held
+   sr_fib_publish(fib, sr->routing_table, sr->rt_seq)
+
+   A version retired at epoch E is freed once every online reader has seen
+   an epoch >= E.
+ */
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#include <inttypes.h>
+#include <pthread.h>
+
+struct sr_rt;
+
+/* One immutable version of the forwarding table */
+struct sr_fib {
+    struct sr_rt *entries;      /* Reachable routes, longest prefix first */
+    unsigned int len;
+    uint32_t gen;               /* sr->rt_seq it was built from */
+    uint64_t retired_at;        /* Epoch it was replaced in */
+    struct sr_fib *next;        /* Next on the retired list */
+};
+
+/* A thread reading the FIB */
+struct sr_fib_reader {
+    uint64_t seen;              /* Last epoch it was quiescent in */
+    int online;                 /* 0 while it holds no FIB pointer at all */
+    struct sr_fib_reader *next;
+};
+
+struct sr_fib_state {
+    struct sr_fib *current;     /* Published version, read atomically */
+    uint64_t epoch;             /* Bumped on every publish */
+    struct sr_fib_reader *readers;
+    struct sr_fib *retired;     /* Replaced versions not yet freed */
+    unsigned long published;
+    unsigned long reclaimed;
+    pthread_mutex_t lock;       /* Guards readers and retired */
+};
+
+void sr_fib_init(struct sr_fib_state *fib);
+
+/* Build a new version from the routing table and publish it. Writers are
+   serialized by the caller (rt_locker). */
+void sr_fib_publish(struct sr_fib_state *fib, struct sr_rt *table, uint32_t gen);
+
+/* Whether the published version was built from generation gen */
+int sr_fib_is_current(struct sr_fib_state *fib, uint32_t gen);
+
+/* Longest prefix match without locks. The route stays valid until the
+   calling reader goes offline. */
+struct sr_rt *sr_fib_lookup(struct sr_fib_state *fib, uint32_t addr);
+
+struct sr_fib_reader *sr_fib_register_reader(struct sr_fib_state *fib);
+void sr_fib_online(struct sr_fib_state *fib, struct sr_fib_reader *reader);
+void sr_fib_offline(struct sr_fib_reader *reader);
+
+void sr_fib_print_stats(struct sr_fib_state *fib);
+
+#endif
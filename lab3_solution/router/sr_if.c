@@ -117,6 +117,12 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         assert(sr->if_list);
         sr->if_list->next = 0;
         sr->if_list->status = 1;
+        sr->if_list->rip_tmpl = 0;
+        sr->if_list->rip_tmpl_expires = 0;
+        sr->if_list->rip_next_ms = 0;
+        sr->if_list->rip_last_ms = 0;
+        sr->if_list->rip_sums = 0;
+        sr->if_list->rip_num_sums = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
         return;
     }
@@ -131,6 +137,12 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
     if_walker->status = 1;
+    if_walker->rip_tmpl = 0;
+    if_walker->rip_tmpl_expires = 0;
+    if_walker->rip_next_ms = 0;
+    if_walker->rip_last_ms = 0;
+    if_walker->rip_sums = 0;
+    if_walker->rip_num_sums = 0;
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
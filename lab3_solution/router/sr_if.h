@@ -24,9 +24,12 @@
 #include <inttypes.h>
 #endif
 
+#include <time.h>
+
 #include "sr_protocol.h"
 
 struct sr_instance;
+struct sr_packet;
 
 /* ----------------------------------------------------------------------------
  * struct sr_if
@@ -43,9 +46,26 @@ struct sr_if
   uint32_t speed;
   uint32_t mask; 
   uint32_t status; /* 0 - interface down; 1 - interface up*/
+  struct sr_packet* rip_tmpl; /* wire-ready RIP responses for this interface */
+  uint32_t rip_tmpl_seq; /* sr->rt_seq, ip and addr they were built for */
+  uint32_t rip_tmpl_ip;
+  unsigned char rip_tmpl_mac[ETHER_ADDR_LEN];
+  time_t rip_tmpl_expires; /* when a withdrawal in them runs out, 0 = never */
+  uint64_t rip_next_ms; /* sr_now_ms() its next regular update is due, 0 = unscheduled */
+  uint64_t rip_last_ms; /* and its last one went out */
+  struct sr_if_rip_sum* rip_sums; /* summaries advertised by its last response */
+  unsigned int rip_num_sums;
   struct sr_if* next;
 };
 
+/* Summary route, aggregate or automatic, advertised out of an interface */
+struct sr_if_rip_sum
+{
+  uint32_t dest;
+  uint32_t mask;
+  time_t withdrawn_time; /* when it went away, 0 while advertised */
+};
+
 struct sr_if_status_cache{
   char name[sr_IFACE_NAMELEN];
   uint32_t status;
@@ -32,6 +32,8 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_pwospf.h"
+#include "sr_bfd.h"
 
 extern char* optarg;
 
@@ -65,11 +67,32 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    double arp_neg_hold = SR_ARPCACHE_NEG_TO;
+    unsigned long arpq_max_bytes = SR_ARPQ_MAX_BYTES;
+    unsigned long arpq_max_iface_bytes = SR_ARPQ_MAX_IFACE_BYTES;
+    enum sr_arpq_drop_policy arpq_drop_policy = arpq_drop_tail;
+    unsigned int rip_trigger_min_ms = SR_RIP_TRIGGER_MIN_MS;
+    unsigned int rip_trigger_max_ms = SR_RIP_TRIGGER_MAX_MS;
+    unsigned int rip_flush_secs = SR_RIP_FLUSH_SECS;
+    unsigned int rip_update_ms = SR_RIP_UPDATE_MS;
+    unsigned int rip_jitter_ms = SR_RIP_JITTER_MS;
+    unsigned int rip_damp_half_life_ms = SR_RIP_DAMP_HALF_LIFE_MS;
+    unsigned int rip_damp_suppress = SR_RIP_DAMP_SUPPRESS;
+    unsigned int rip_damp_reuse = SR_RIP_DAMP_REUSE;
+    enum sr_routing_protocol routing_protocol = routing_rip;
+    unsigned int pwospf_spf_hold_ms = SR_PWOSPF_SPF_HOLD_MS;
+    unsigned int bfd_interval_ms = SR_BFD_INTERVAL_MS;
+    unsigned int bfd_detect_mult = SR_BFD_DETECT_MULT;
+    char *rip_aggregates = NULL;
+    int rip_auto_summary = 0;
+    char *rip_imports = NULL;
+    int arp_warmup = 0;
+    char *arp_warmup_hosts = NULL;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:n:Wa:Q:q:D:x:X:g:F:S:R:U:J:P:H:b:B:A:ZI:")) != EOF)
     {
         switch (c)
         {
@@ -101,11 +124,128 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'n':
+                arp_neg_hold = atof((char *) optarg);
+                break;
+            case 'Q':
+                arpq_max_bytes = strtoul((char *) optarg, NULL, 10);
+                break;
+            case 'q':
+                arpq_max_iface_bytes = strtoul((char *) optarg, NULL, 10);
+                break;
+            case 'D':
+                if (strcmp(optarg, "head") == 0)
+                    arpq_drop_policy = arpq_drop_head;
+                else if (strcmp(optarg, "tail") == 0)
+                    arpq_drop_policy = arpq_drop_tail;
+                else {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'x':
+                rip_trigger_min_ms = atoi((char *) optarg);
+                break;
+            case 'X':
+                rip_trigger_max_ms = atoi((char *) optarg);
+                break;
+            case 'g':
+                rip_flush_secs = atoi((char *) optarg);
+                break;
+            case 'U':
+                rip_update_ms = atoi((char *) optarg);
+                break;
+            case 'J':
+                rip_jitter_ms = atoi((char *) optarg);
+                break;
+            case 'F':
+                rip_damp_half_life_ms = atof((char *) optarg) * 1000;
+                break;
+            case 'S':
+                rip_damp_suppress = atoi((char *) optarg);
+                break;
+            case 'R':
+                rip_damp_reuse = atoi((char *) optarg);
+                break;
+            case 'P':
+                if (strcmp(optarg, "rip") == 0)
+                    routing_protocol = routing_rip;
+                else if (strcmp(optarg, "pwospf") == 0)
+                    routing_protocol = routing_pwospf;
+                else {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'H':
+                pwospf_spf_hold_ms = atoi((char *) optarg);
+                break;
+            case 'b':
+                bfd_interval_ms = atoi((char *) optarg);
+                break;
+            case 'B':
+                bfd_detect_mult = atoi((char *) optarg);
+                break;
+            case 'A':
+                rip_aggregates = optarg;
+                break;
+            case 'Z':
+                rip_auto_summary = 1;
+                break;
+            case 'I':
+                rip_imports = optarg;
+                break;
+            case 'W':
+                arp_warmup = 1;
+                break;
+            case 'a':
+                arp_warmup = 1;
+                arp_warmup_hosts = optarg;
+                break;
         } /* switch */
     } /* -- while -- */
 
+    if (rip_update_ms == 0)
+        rip_update_ms = SR_RIP_UPDATE_MS;
+    if (rip_jitter_ms > rip_update_ms / 2)
+        rip_jitter_ms = rip_update_ms / 2;
+
+    if (bfd_interval_ms != 0 && bfd_interval_ms < SR_BFD_MIN_INTERVAL_MS)
+        bfd_interval_ms = SR_BFD_MIN_INTERVAL_MS;
+    if (bfd_interval_ms > SR_BFD_MAX_INTERVAL_MS)
+        bfd_interval_ms = SR_BFD_MAX_INTERVAL_MS;
+    if (bfd_detect_mult == 0 || bfd_detect_mult > 255)
+        bfd_detect_mult = SR_BFD_DETECT_MULT;
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.arp_neg_hold = arp_neg_hold;
+    sr.arpq_max_bytes = arpq_max_bytes;
+    sr.arpq_max_iface_bytes = arpq_max_iface_bytes;
+    sr.arpq_drop_policy = arpq_drop_policy;
+    sr.rip_trigger_min_ms = rip_trigger_min_ms;
+    sr.rip_trigger_max_ms = rip_trigger_max_ms;
+    sr.rip_flush_secs = rip_flush_secs;
+    sr.rip_update_ms = rip_update_ms;
+    sr.rip_jitter_ms = rip_jitter_ms;
+    sr.rip_damp_half_life_ms = rip_damp_half_life_ms;
+    sr.rip_damp_suppress = rip_damp_suppress;
+    sr.rip_damp_reuse = rip_damp_reuse;
+    sr.routing_protocol = routing_protocol;
+    sr.pwospf_spf_hold_ms = pwospf_spf_hold_ms;
+    sr.bfd_interval_ms = bfd_interval_ms;
+    sr.bfd_detect_mult = bfd_detect_mult;
+    sr.rip_auto_summary = rip_auto_summary;
+    if (rip_aggregates != NULL && sr_rip_add_aggregates(&sr, rip_aggregates) != 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (rip_imports != NULL && sr_rip_load_imports(&sr, rip_imports) != 0) {
+        fprintf(stderr, "Error loading import policy from %s\n", rip_imports);
+        exit(1);
+    }
+    sr.arp_warmup = arp_warmup;
+    sr.arp_warmup_hosts = arp_warmup_hosts;
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -173,7 +313,19 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-n arp negative hold secs] \n");
+    printf("           [-W] [-a arp warm-up host list] \n");
+    printf("           [-Q arp queue bytes] [-q arp queue bytes per iface] \n");
+    printf("           [-D head|tail arp queue drop policy] \n");
+    printf("           [-x min ms] [-X max ms] rip triggered update window \n");
+    printf("           [-g secs] rip unreachable route flush interval \n");
+    printf("           [-U ms] [-J ms] rip update period and jitter \n");
+    printf("           [-F half-life secs] [-S suppress] [-R reuse] rip flap damping \n");
+    printf("           [-P rip|pwospf] routing protocol \n");
+    printf("           [-H ms] pwospf SPF hold time \n");
+    printf("           [-b ms] [-B multiplier] bfd interval (50-300, 0 disables) \n");
+    printf("           [-A iface:prefix/len,...] [-Z] rip aggregates, auto summarization \n");
+    printf("           [-I policy file] rip import filters and max-prefix limits \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -244,12 +396,66 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->if_list = 0;
     sr->if_cache = 0;
     sr->routing_table = 0;
+    sr->rt_tail = 0;
+    memset(sr->rt_hash, 0, sizeof(sr->rt_hash));
+    sr->rt_slabs = 0;
+    sr->rt_free = 0;
+    sr->rt_count = 0;
+    sr->rt_slab_count = 0;
+    sr->rt_flushed = 0;
+    sr->rt_if_events = 0;
+    sr->rip_nbrs = 0;
+    sr->rip_nbr_expiries = 0;
+    sr->rip_dup_skips = 0;
+    sr->rt_failovers = 0;
+    sr->rt_damp_flaps = 0;
+    sr->rt_damp_suppressions = 0;
+    sr->rip_tmpl_builds = 0;
+    sr->rip_tmpl_reuses = 0;
+    sr->rt_seq = 0;
+    sr->rt_backup_gen = 0;
+    sr->rt_sync_gen = 0;
+    sr->rip_trigger_seq = 0;
+    sr_fib_init(&(sr->fib));
+    sr->fib_reader = 0;
     sr->logfile = 0;
+    sr->arp_neg_hold = SR_ARPCACHE_NEG_TO;
+    sr->arpq_max_bytes = SR_ARPQ_MAX_BYTES;
+    sr->arpq_max_iface_bytes = SR_ARPQ_MAX_IFACE_BYTES;
+    sr->arpq_drop_policy = arpq_drop_tail;
+    sr->rip_trigger_min_ms = SR_RIP_TRIGGER_MIN_MS;
+    sr->rip_trigger_max_ms = SR_RIP_TRIGGER_MAX_MS;
+    sr->rip_flush_secs = SR_RIP_FLUSH_SECS;
+    sr->rip_update_ms = SR_RIP_UPDATE_MS;
+    sr->rip_jitter_ms = SR_RIP_JITTER_MS;
+    memset(sr->rip_jitter_hist, 0, sizeof(sr->rip_jitter_hist));
+    sr->rip_jitter_late = 0;
+    sr->rip_damp_half_life_ms = SR_RIP_DAMP_HALF_LIFE_MS;
+    sr->rip_damp_suppress = SR_RIP_DAMP_SUPPRESS;
+    sr->rip_damp_reuse = SR_RIP_DAMP_REUSE;
+    sr->routing_protocol = routing_rip;
+    sr->pwospf = 0;
+    sr->pwospf_spf_hold_ms = SR_PWOSPF_SPF_HOLD_MS;
+    sr->bfd = 0;
+    sr->bfd_interval_ms = SR_BFD_INTERVAL_MS;
+    sr->bfd_detect_mult = SR_BFD_DETECT_MULT;
+    sr->rip_aggregates = 0;
+    sr->rip_imports = 0;
+    sr->rip_auto_summary = 0;
+    sr->rip_sum_routes = 0;
+    sr->rip_sum_entries = 0;
+    sr->arp_warmup = 0;
+    sr->arp_warmup_hosts = 0;
 
     srand(time(NULL));
     pthread_mutexattr_init(&(sr->rt_locker_attr));
     pthread_mutexattr_settype(&(sr->rt_locker_attr), PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&(sr->rt_locker), &(sr->rt_locker_attr));
+    sr->rt_lock_depth = 0;
+    sr->rt_lock_holds = 0;
+    sr->rt_lock_hold_us = 0;
+    sr->rt_lock_hold_max_us = 0;
+    pthread_mutex_init(&(sr->rip_send_lock), NULL);
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
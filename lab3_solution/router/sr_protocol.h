@@ -93,6 +93,51 @@ struct sr_rip_pkt {
 } __attribute__ ((packed)) ;
 typedef struct sr_rip_pkt sr_rip_pkt_t;
 
+/* A RIP packet on the wire carries only as many entries as the UDP length
+   says, at most MAX_NUM_ENTRIES */
+#define SR_RIP_HDR_LEN 4 /* command, version, unused */
+
+/* PWOSPF, the simplified OSPFv2 of the Stanford router project. Every
+   packet starts with the OSPF header; hellos and link state updates are
+   the only types. */
+#define OSPF_V2 2
+#define OSPF_TYPE_HELLO 1
+#define OSPF_TYPE_LSU 4
+#define OSPF_AllSPFRouters 0xe0000005 /* 224.0.0.5 */
+
+struct sr_ospf_hdr {
+  uint8_t version;
+  uint8_t type;
+  uint16_t len;     /* of the OSPF packet, header included */
+  uint32_t rid;     /* router ID of the sender */
+  uint32_t aid;     /* area ID */
+  uint16_t csum;    /* over the packet, authentication excluded */
+  uint16_t autype;
+  uint32_t auth[2];
+} __attribute__ ((packed)) ;
+typedef struct sr_ospf_hdr sr_ospf_hdr_t;
+
+struct sr_ospf_hello {
+  uint32_t nmask;    /* mask of the interface it is sent on */
+  uint16_t helloint; /* seconds between hellos */
+  uint16_t padding;
+} __attribute__ ((packed)) ;
+typedef struct sr_ospf_hello sr_ospf_hello_t;
+
+struct sr_ospf_lsu {
+  uint16_t seq;
+  uint16_t ttl;
+  uint32_t num_adv; /* sr_ospf_lsa_t that follow */
+} __attribute__ ((packed)) ;
+typedef struct sr_ospf_lsu sr_ospf_lsu_t;
+
+struct sr_ospf_lsa {
+  uint32_t subnet;
+  uint32_t mask;
+  uint32_t rid; /* router on the other side of the link, 0 for a stub */
+} __attribute__ ((packed)) ;
+typedef struct sr_ospf_lsa sr_ospf_lsa_t;
+
 struct sr_udp_hdr {
   uint16_t port_src, port_dst; /* source and dest port_number */
   uint16_t udp_len;			/* total length */
@@ -100,6 +145,31 @@ struct sr_udp_hdr {
 } __attribute__ ((packed)) ;
 typedef struct sr_udp_hdr sr_udp_hdr_t;
 
+/* BFD control packet (RFC 5880), single hop over UDP (RFC 5881) */
+#define BFD_PORT 3784
+#define BFD_V1 1
+#define BFD_TTL 255 /* only accepted from a directly connected neighbor */
+#define BFD_STATE_ADMIN_DOWN 0
+#define BFD_STATE_DOWN 1
+#define BFD_STATE_INIT 2
+#define BFD_STATE_UP 3
+#define BFD_DIAG_NONE 0
+#define BFD_DIAG_EXPIRED 1   /* control detection time expired */
+#define BFD_DIAG_NBR_DOWN 3  /* neighbor signaled session down */
+
+struct sr_bfd_hdr {
+  uint8_t vers_diag;    /* version << 5 | diagnostic */
+  uint8_t state_flags;  /* state << 6 | flags */
+  uint8_t detect_mult;
+  uint8_t len;
+  uint32_t my_disc;
+  uint32_t your_disc;
+  uint32_t min_tx;      /* desired min TX interval, microseconds */
+  uint32_t min_rx;      /* required min RX interval, microseconds */
+  uint32_t min_echo_rx;
+} __attribute__ ((packed)) ;
+typedef struct sr_bfd_hdr sr_bfd_hdr_t;
+
 
 /* Structure of a ICMP header
  */
@@ -195,7 +265,9 @@ typedef struct sr_ethernet_hdr sr_ethernet_hdr_t;
 
 enum sr_ip_protocol {
   ip_protocol_icmp = 0x0001,
+  ip_protocol_tcp = 0x0006,
   ip_protocol_udp = 0x0011,
+  ip_protocol_ospf = 0x0059,
 };
 
 enum sr_ethertype {
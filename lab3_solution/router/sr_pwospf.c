@@ -0,0 +1,945 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pwospf.c
+ *
+ * Description:
+ *
+ * PWOSPF engine: neighbor discovery, LSU flooding, the link state database
+ * and the shortest path computation that feeds the routing table
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_pwospf.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+#include "sr_router.h"
+#include "sr_bfd.h"
+
+#define SR_PWOSPF_UNREACHED 0xffffffff
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_init()
+ * @brief function sets up the PWOSPF engine and starts its timer thread
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_pwospf_init(struct sr_instance *sr) {
+  struct sr_pwospf *ospf = (struct sr_pwospf *)calloc(1, sizeof(struct sr_pwospf));
+  pthread_condattr_t cond_attr;
+  pthread_t thread;
+
+  assert(ospf);
+  pthread_mutex_init(&(ospf->lock), NULL);
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&(ospf->cond), &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  ospf->lsa_changed = 1;
+  ospf->spf_full = 1;
+  sr->pwospf = ospf;
+
+  pthread_create(&thread, &(sr->rt_attr), sr_pwospf_timeout, sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_rid()
+ * @brief function returns our router ID, the IP of the first interface,
+ * once the interfaces are known. Called with the engine lock held.
+ * @param sr: pointer to simple router state.
+ * @return: the router ID, 0 before the hardware information arrived
+ *---------------------------------------------------------------------*/
+static uint32_t sr_pwospf_rid(struct sr_instance *sr) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  if(ospf->rid == 0 && sr->if_list != NULL){
+    ospf->rid = sr->if_list->ip;
+  }
+  return ospf->rid;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_lsdb_find()
+ * @brief function finds the database entry of a router
+ * @param ospf: the engine
+ * @param rid: router ID
+ * @return: the entry, NULL if the router is unknown
+ *---------------------------------------------------------------------*/
+static struct sr_pwospf_router* sr_pwospf_lsdb_find(struct sr_pwospf *ospf, uint32_t rid) {
+  struct sr_pwospf_router* router;
+  for(router = ospf->lsdb; router; router = router->next){
+    if(router->rid == rid){
+      return router;
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_lsdb_store()
+ * @brief function stores the LSA of a router, replacing the one it had
+ * @param ospf: the engine
+ * @param rid: router ID
+ * @param seq: sequence number of the LSA
+ * @param adv: its advertisements, in network order
+ * @param num_adv: number of advertisements
+ * @param now: sr_now_ms()
+ * @return: true if the router's links changed
+ *---------------------------------------------------------------------*/
+static bool sr_pwospf_lsdb_store(struct sr_pwospf *ospf, uint32_t rid, uint16_t seq,
+                                 const sr_ospf_lsa_t *adv, unsigned int num_adv, uint64_t now) {
+  struct sr_pwospf_router* router = sr_pwospf_lsdb_find(ospf, rid);
+  bool changed;
+
+  if(router == NULL){
+    router = (struct sr_pwospf_router*)calloc(1, sizeof(struct sr_pwospf_router));
+    assert(router);
+    router->rid = rid;
+    router->dist = SR_PWOSPF_UNREACHED;
+    router->next = ospf->lsdb;
+    ospf->lsdb = router;
+    changed = true;
+  }
+  else{
+    changed = router->num_adv != num_adv ||
+              memcmp(router->adv, adv, num_adv * sizeof(sr_ospf_lsa_t)) != 0;
+  }
+  if(changed){
+    free(router->adv);
+    router->adv = (sr_ospf_lsa_t*)malloc((num_adv + 1) * sizeof(sr_ospf_lsa_t));
+    assert(router->adv);
+    memcpy(router->adv, adv, num_adv * sizeof(sr_ospf_lsa_t));
+    router->num_adv = num_adv;
+    router->changed = 1;
+  }
+  router->seq = seq;
+  router->updated_ms = now;
+  return changed;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf_schedule()
+ * @brief function schedules an SPF run after a database change. The run
+ * waits out the hold time from the first change, so a burst of LSUs is
+ * folded into one run. Called with the engine lock held.
+ * @param sr: pointer to simple router state.
+ * @param now: sr_now_ms()
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_spf_schedule(struct sr_instance *sr, uint64_t now) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  if(!ospf->spf_pending){
+    ospf->spf_pending = 1;
+    ospf->spf_due_ms = now + sr->pwospf_spf_hold_ms;
+    pthread_cond_signal(&(ospf->cond));
+  }
+  ospf->spf_changes++;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_packet()
+ * @brief function allocates an OSPF packet sent out of an interface, with
+ * the Ethernet, IP and OSPF headers filled in, except the OSPF checksum.
+ * Called with the engine lock held.
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface it is sent on
+ * @param type: OSPF_TYPE_HELLO or OSPF_TYPE_LSU
+ * @param body_len: bytes after the OSPF header
+ * @return: the packet, queued on nothing
+ *---------------------------------------------------------------------*/
+static struct sr_packet* sr_pwospf_packet(struct sr_instance *sr, struct sr_if *interface,
+                                          uint8_t type, unsigned int body_len) {
+  unsigned int ospf_len = sizeof(sr_ospf_hdr_t) + body_len;
+  struct sr_packet* pkt = (struct sr_packet*)calloc(1, sizeof(struct sr_packet));
+  assert(pkt);
+  pkt->len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + ospf_len;
+  pkt->buf = (uint8_t*)calloc(1, pkt->len);
+  assert(pkt->buf);
+  pkt->iface = interface->name;
+
+  /* 1.a Set Ethernet header */
+  sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)pkt->buf;
+  memcpy(ethernet_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
+  memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+  ethernet_hdr->ether_type = htons(ethertype_ip);
+
+  /* 1.b Set IP header, link-local */
+  sr_ip_hdr_t* ip = (sr_ip_hdr_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t));
+  ip->ip_hl = 0x5;
+  ip->ip_v  = 0x4;
+  ip->ip_tos = iptos;
+  ip->ip_len = htons((uint16_t)(sizeof(sr_ip_hdr_t) + ospf_len));
+  ip->ip_id = htons(ipid);
+  ip->ip_off = htons(ipoff);
+  ip->ip_ttl = 1;
+  ip->ip_p = ip_protocol_ospf;
+  ip->ip_src = interface->ip;
+  ip->ip_dst = htonl(OSPF_AllSPFRouters);
+  ip->ip_sum = 0;
+  ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+  /* 1.c Set OSPF header */
+  sr_ospf_hdr_t* ospf_hdr = (sr_ospf_hdr_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+  ospf_hdr->version = OSPF_V2;
+  ospf_hdr->type = type;
+  ospf_hdr->len = htons((uint16_t)ospf_len);
+  ospf_hdr->rid = sr->pwospf->rid;
+  ospf_hdr->aid = htonl(SR_PWOSPF_AREA);
+  ospf_hdr->autype = 0;
+  return pkt;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_cksum()
+ * @brief function computes the checksum of an OSPF packet, taken over the
+ * whole packet with the checksum zeroed and the authentication excluded
+ * @param hdr: the OSPF header
+ * @param len: length of the OSPF packet
+ * @return: the checksum
+ *---------------------------------------------------------------------*/
+static uint16_t sr_pwospf_cksum(sr_ospf_hdr_t *hdr, unsigned int len) {
+  uint32_t auth[2];
+  uint16_t csum = hdr->csum;
+  uint16_t sum;
+
+  memcpy(auth, hdr->auth, sizeof(auth));
+  memset(hdr->auth, 0, sizeof(auth));
+  hdr->csum = 0;
+  sum = cksum(hdr, len);
+  memcpy(hdr->auth, auth, sizeof(auth));
+  hdr->csum = csum;
+  return sum;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_lsu_packet()
+ * @brief function builds the LSU carrying a router's LSA. Called with the
+ * engine lock held.
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface it is sent on
+ * @param router: the router the LSA describes
+ * @param ttl: hops it may still be flooded
+ * @return: the packet
+ *---------------------------------------------------------------------*/
+static struct sr_packet* sr_pwospf_lsu_packet(struct sr_instance *sr, struct sr_if *interface,
+                                              struct sr_pwospf_router *router, uint16_t ttl) {
+  unsigned int body_len = sizeof(sr_ospf_lsu_t) + router->num_adv * sizeof(sr_ospf_lsa_t);
+  struct sr_packet* pkt = sr_pwospf_packet(sr, interface, OSPF_TYPE_LSU, body_len);
+  sr_ospf_hdr_t* ospf_hdr = (sr_ospf_hdr_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+  sr_ospf_lsu_t* lsu = (sr_ospf_lsu_t *)(ospf_hdr + 1);
+
+  /* the LSA keeps its originator, whoever floods it */
+  ospf_hdr->rid = router->rid;
+  lsu->seq = htons(router->seq);
+  lsu->ttl = htons(ttl);
+  lsu->num_adv = htonl(router->num_adv);
+  memcpy(lsu + 1, router->adv, router->num_adv * sizeof(sr_ospf_lsa_t));
+  ospf_hdr->csum = sr_pwospf_cksum(ospf_hdr, sizeof(sr_ospf_hdr_t) + body_len);
+  return pkt;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_has_nbr()
+ * @brief function tells whether we have a neighbor on an interface
+ * @param ospf: the engine
+ * @param if_name: the interface
+ *---------------------------------------------------------------------*/
+static bool sr_pwospf_has_nbr(struct sr_pwospf *ospf, const char *if_name) {
+  struct sr_pwospf_nbr* nbr;
+  for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+    if(strcmp(nbr->interface, if_name) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_flood()
+ * @brief function queues the LSU of a router on every interface with a
+ * neighbor, except the one it came in on. Called with the engine lock
+ * held.
+ * @param sr: pointer to simple router state.
+ * @param router: the router the LSA describes
+ * @param ttl: hops it may still be flooded
+ * @param from: interface it was received on, NULL for our own LSA
+ * @param outbox: queue of packets to send once the lock is released
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_flood(struct sr_instance *sr, struct sr_pwospf_router *router,
+                            uint16_t ttl, const char *from, struct sr_packet **outbox) {
+  struct sr_if* interface;
+  for(interface = sr->if_list; interface; interface = interface->next){
+    if((from != NULL && strcmp(interface->name, from) == 0) ||
+       !sr_pwospf_has_nbr(sr->pwospf, interface->name) ||
+       sr_obtain_interface_status(sr, interface->name) == 0){
+      continue;
+    }
+    struct sr_packet* pkt = sr_pwospf_lsu_packet(sr, interface, router, ttl);
+    pkt->next = *outbox;
+    *outbox = pkt;
+    if(from == NULL){
+      sr->pwospf->lsus_sent++;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_originate()
+ * @brief function describes our links in a new LSA, one advertisement per
+ * neighbor of each up interface, or a stub one for an interface without
+ * neighbors, and floods it. Called with the engine lock held.
+ * @param sr: pointer to simple router state.
+ * @param now: sr_now_ms()
+ * @param outbox: queue of packets to send once the lock is released
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_originate(struct sr_instance *sr, uint64_t now, struct sr_packet **outbox) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  struct sr_if* interface;
+  struct sr_pwospf_nbr* nbr;
+  sr_ospf_lsa_t* adv;
+  unsigned int num_adv = 0, max_adv = 0;
+
+  for(interface = sr->if_list; interface; interface = interface->next){
+    max_adv++;
+  }
+  for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+    max_adv++;
+  }
+  adv = (sr_ospf_lsa_t*)malloc((max_adv + 1) * sizeof(sr_ospf_lsa_t));
+  assert(adv);
+
+  for(interface = sr->if_list; interface; interface = interface->next){
+    bool linked = false;
+    if(sr_obtain_interface_status(sr, interface->name) == 0){
+      continue;
+    }
+    for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+      if(strcmp(nbr->interface, interface->name) == 0){
+        adv[num_adv].subnet = interface->ip & interface->mask;
+        adv[num_adv].mask = interface->mask;
+        adv[num_adv].rid = nbr->rid;
+        num_adv++;
+        linked = true;
+      }
+    }
+    if(!linked){
+      adv[num_adv].subnet = interface->ip & interface->mask;
+      adv[num_adv].mask = interface->mask;
+      adv[num_adv].rid = 0;
+      num_adv++;
+    }
+  }
+
+  ospf->seq++;
+  if(sr_pwospf_lsdb_store(ospf, ospf->rid, ospf->seq, adv, num_adv, now)){
+    sr_pwospf_spf_schedule(sr, now);
+  }
+  free(adv);
+  sr_pwospf_flood(sr, sr_pwospf_lsdb_find(ospf, ospf->rid), SR_PWOSPF_LSU_TTL, NULL, outbox);
+  ospf->lsa_changed = 0;
+  ospf->next_lsu_ms = now + SR_PWOSPF_LSUINT * 1000;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_links()
+ * @brief function tells whether a router advertises a link to another,
+ * so only links both ends agree on are used
+ * @param router: the router
+ * @param rid: the other router
+ *---------------------------------------------------------------------*/
+static bool sr_pwospf_links(struct sr_pwospf_router *router, uint32_t rid) {
+  unsigned int i;
+  for(i = 0; i < router->num_adv; i++){
+    if(router->adv[i].rid == rid){
+      return true;
+    }
+  }
+  return false;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf_relax()
+ * @brief function shortens the path to v through u if it can, queueing v
+ * to pass the improvement on
+ * @param ospf: the engine
+ * @param self: our own database entry
+ * @param u: a reached router
+ * @param v: a router u has a two-way link with
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_spf_relax(struct sr_pwospf *ospf, struct sr_pwospf_router *self,
+                                struct sr_pwospf_router *u, struct sr_pwospf_router *v) {
+  if(u->dist == SR_PWOSPF_UNREACHED || u->dist + 1 >= v->dist){
+    return;
+  }
+  v->dist = u->dist + 1;
+  v->parent = u;
+  v->first_hop = (u == self) ? v : u->first_hop;
+  if(!v->queued){
+    if(ospf->open_len == ospf->open_max){
+      ospf->open_max = ospf->open_max ? ospf->open_max * 2 : 16;
+      ospf->open = (struct sr_pwospf_router**)realloc(ospf->open,
+                     ospf->open_max * sizeof(struct sr_pwospf_router*));
+      assert(ospf->open);
+    }
+    ospf->open[ospf->open_len++] = v;
+    v->queued = 1;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf_neighbors()
+ * @brief function relaxes every two-way link of a router, both ways
+ * @param ospf: the engine
+ * @param self: our own database entry
+ * @param u: the router
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_spf_neighbors(struct sr_pwospf *ospf, struct sr_pwospf_router *self,
+                                    struct sr_pwospf_router *u) {
+  unsigned int i;
+  for(i = 0; i < u->num_adv; i++){
+    struct sr_pwospf_router* v;
+    if(u->adv[i].rid == 0 || (v = sr_pwospf_lsdb_find(ospf, u->adv[i].rid)) == NULL ||
+       !sr_pwospf_links(v, u->rid)){
+      continue;
+    }
+    sr_pwospf_spf_relax(ospf, self, u, v);
+    sr_pwospf_spf_relax(ospf, self, v, u);
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf_orphaned()
+ * @brief function tells whether the tree path to a router runs through a
+ * link that broke, remembering the answer along the way
+ * @param router: the router
+ *---------------------------------------------------------------------*/
+static bool sr_pwospf_spf_orphaned(struct sr_pwospf_router *router) {
+  if(router->orphaned == 0){
+    router->orphaned = (router->parent != NULL && sr_pwospf_spf_orphaned(router->parent)) ? 2 : 1;
+  }
+  return router->orphaned == 2;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf_tree()
+ * @brief function brings the shortest path tree up to date, every link
+ * costing one hop. After a change to some LSAs only the affected part is
+ * recomputed: the subtrees hanging below a tree link that broke are cut
+ * off and reattached through their other links, and a link that was
+ * added shortens the paths it can. Dijkstra then only settles routers
+ * whose distance changed. From scratch, the whole tree is cut off.
+ * Called with the engine lock held.
+ * @param ospf: the engine
+ * @param self: our own database entry
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_spf_tree(struct sr_pwospf *ospf, struct sr_pwospf_router *self) {
+  struct sr_pwospf_router* router;
+
+  /* 1 Cut off what the change made unreachable by its tree path */
+  for(router = ospf->lsdb; router; router = router->next){
+    router->orphaned = 0;
+  }
+  for(router = ospf->lsdb; router; router = router->next){
+    struct sr_pwospf_router* parent = router->parent;
+    if(ospf->spf_full ? router != self :
+       (parent != NULL && (parent->changed || router->changed) &&
+        !(sr_pwospf_links(parent, router->rid) && sr_pwospf_links(router, parent->rid)))){
+      router->orphaned = 2;
+    }
+  }
+  self->orphaned = 1;
+  self->parent = NULL;
+  self->first_hop = NULL;
+  self->dist = 0;
+  for(router = ospf->lsdb; router; router = router->next){
+    if(sr_pwospf_spf_orphaned(router)){
+      router->dist = SR_PWOSPF_UNREACHED;
+      router->parent = NULL;
+      router->first_hop = NULL;
+    }
+  }
+
+  /* 2 Reattach the cut off routers and use the changed links */
+  ospf->open_len = 0;
+  for(router = ospf->lsdb; router; router = router->next){
+    if(router->changed || router->orphaned == 2 || router == self){
+      sr_pwospf_spf_neighbors(ospf, self, router);
+    }
+  }
+
+  /* 3 Dijkstra over the routers whose distance went down */
+  while(ospf->open_len > 0){
+    unsigned int i, best = 0;
+    for(i = 1; i < ospf->open_len; i++){
+      if(ospf->open[i]->dist < ospf->open[best]->dist){
+        best = i;
+      }
+    }
+    router = ospf->open[best];
+    ospf->open[best] = ospf->open[--ospf->open_len];
+    router->queued = 0;
+    ospf->spf_visits++;
+    sr_pwospf_spf_neighbors(ospf, self, router);
+  }
+
+  for(router = ospf->lsdb; router; router = router->next){
+    router->changed = 0;
+  }
+  ospf->spf_full_runs += ospf->spf_full;
+  ospf->spf_full = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_spf()
+ * @brief function updates the shortest path tree and turns it into
+ * routes: each subnet a reached router advertises is routed through the
+ * neighbor the path to that router starts at. Called with the engine lock
+ * held.
+ * @param sr: pointer to simple router state.
+ * @param n: set to the number of routes
+ * @return: the routes, to be freed by the caller
+ *---------------------------------------------------------------------*/
+static struct sr_rt* sr_pwospf_spf(struct sr_instance *sr, unsigned int *n) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  struct sr_pwospf_router* self = sr_pwospf_lsdb_find(ospf, ospf->rid);
+  struct sr_pwospf_router* router;
+  struct sr_rt* routes;
+  unsigned int max_routes = 0, i, j;
+  uint64_t start = sr_now_us();
+
+  *n = 0;
+  if(self == NULL){
+    return NULL;
+  }
+
+  /* 1 Shortest path tree */
+  sr_pwospf_spf_tree(ospf, self);
+  for(router = ospf->lsdb; router; router = router->next){
+    max_routes += router->num_adv;
+  }
+
+  /* 2 Routes to the subnets of every reached router, the closest wins */
+  routes = (struct sr_rt*)calloc(max_routes + 1, sizeof(struct sr_rt));
+  assert(routes);
+  for(router = ospf->lsdb; router; router = router->next){
+    struct sr_pwospf_nbr* nbr = NULL;
+    if(router->dist == SR_PWOSPF_UNREACHED){
+      continue;
+    }
+    if(router != self){
+      for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+        if(nbr->rid == router->first_hop->rid){
+          break;
+        }
+      }
+      if(nbr == NULL){
+        continue;
+      }
+    }
+    for(i = 0; i < router->num_adv; i++){
+      struct sr_rt route;
+      memset(&route, 0, sizeof(route));
+      route.mask.s_addr = router->adv[i].mask;
+      route.dest.s_addr = router->adv[i].subnet & route.mask.s_addr;
+      if(router == self){
+        struct sr_if* interface;
+        for(interface = sr->if_list; interface; interface = interface->next){
+          if((interface->ip & interface->mask) == route.dest.s_addr &&
+             interface->mask == route.mask.s_addr){
+            break;
+          }
+        }
+        if(interface == NULL){
+          continue;
+        }
+        memcpy(route.interface, interface->name, sr_IFACE_NAMELEN);
+        route.metric = 0;
+      }
+      else{
+        route.gw.s_addr = nbr->ip;
+        memcpy(route.interface, nbr->interface, sr_IFACE_NAMELEN);
+        route.metric = router->dist < INFINITY ? router->dist : INFINITY - 1;
+      }
+      for(j = 0; j < *n; j++){
+        if(routes[j].dest.s_addr == route.dest.s_addr && routes[j].mask.s_addr == route.mask.s_addr){
+          break;
+        }
+      }
+      if(j == *n){
+        routes[(*n)++] = route;
+      }
+      else if(route.metric < routes[j].metric){
+        routes[j] = route;
+      }
+    }
+  }
+
+  uint64_t took = sr_now_us() - start;
+  unsigned int b = 0;
+  ospf->spf_runs++;
+  ospf->spf_us += took;
+  if(took > ospf->spf_max_us){
+    ospf->spf_max_us = took;
+  }
+  while(b < SR_PWOSPF_SPF_HIST_BUCKETS - 1 && took + 1 >= (2ull << b)){
+    b++;
+  }
+  ospf->spf_hist[b]++;
+  ospf->spf_pending = 0;
+  return routes;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_send()
+ * @brief function sends and frees the queued packets
+ * @param sr: pointer to simple router state.
+ * @param outbox: the queue
+ *---------------------------------------------------------------------*/
+static void sr_pwospf_send(struct sr_instance *sr, struct sr_packet *outbox) {
+  while(outbox){
+    struct sr_packet* next = outbox->next;
+    sr_send_packet(sr, outbox->buf, outbox->len, outbox->iface);
+    free(outbox->buf);
+    free(outbox);
+    outbox = next;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_timeout()
+ * @brief function runs the PWOSPF timers: hellos every HELLOINT, dead
+ * neighbors and stale LSAs, our LSA refresh every LSUINT, and the SPF
+ * recomputation after any change to the database
+ * @param sr_ptr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void *sr_pwospf_timeout(void *sr_ptr) {
+  struct sr_instance *sr = sr_ptr;
+  struct sr_pwospf *ospf = sr->pwospf;
+
+  while (1) {
+    struct sr_packet* outbox = NULL;
+    struct sr_rt* routes = NULL;
+    unsigned int num_routes = 0;
+
+    pthread_mutex_lock(&(ospf->lock));
+    /* 1 Sleep until a timer is due or something changed */
+    while (1) {
+      uint64_t now = sr_now_ms();
+      uint64_t wake = ospf->next_hello_ms < ospf->next_lsu_ms ? ospf->next_hello_ms : ospf->next_lsu_ms;
+      if (ospf->spf_pending && ospf->spf_due_ms < wake) {
+        wake = ospf->spf_due_ms;
+      }
+      if (now >= wake || ospf->lsa_changed) {
+        break;
+      }
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_sec += (wake - now) / 1000;
+      ts.tv_nsec += ((wake - now) % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&(ospf->cond), &(ospf->lock), &ts);
+    }
+    uint64_t now = sr_now_ms();
+
+    if (sr_pwospf_rid(sr) == 0) {
+      /* no interfaces yet */
+      ospf->next_hello_ms = now + 100;
+      ospf->next_lsu_ms = ospf->next_hello_ms;
+      pthread_mutex_unlock(&(ospf->lock));
+      continue;
+    }
+
+    /* 2 Hellos on every up interface */
+    if (now >= ospf->next_hello_ms) {
+      struct sr_if* interface;
+      for (interface = sr->if_list; interface; interface = interface->next) {
+        if (sr_obtain_interface_status(sr, interface->name) == 0) {
+          continue;
+        }
+        struct sr_packet* pkt = sr_pwospf_packet(sr, interface, OSPF_TYPE_HELLO, sizeof(sr_ospf_hello_t));
+        sr_ospf_hdr_t* ospf_hdr = (sr_ospf_hdr_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+        sr_ospf_hello_t* hello = (sr_ospf_hello_t *)(ospf_hdr + 1);
+        hello->nmask = interface->mask;
+        hello->helloint = htons(SR_PWOSPF_HELLOINT);
+        ospf_hdr->csum = sr_pwospf_cksum(ospf_hdr, sizeof(sr_ospf_hdr_t) + sizeof(sr_ospf_hello_t));
+        pkt->next = outbox;
+        outbox = pkt;
+        ospf->hellos_sent++;
+      }
+      ospf->next_hello_ms = now + SR_PWOSPF_HELLOINT * 1000;
+    }
+
+    /* 3 Neighbors that went silent are gone, and so are our links to them */
+    struct sr_pwospf_nbr** link = &(ospf->nbrs);
+    while (*link) {
+      struct sr_pwospf_nbr* nbr = *link;
+      if (now - nbr->last_hello_ms > SR_PWOSPF_HELLOINT * SR_PWOSPF_DEAD_MULT * 1000) {
+        *link = nbr->next;
+        free(nbr);
+        ospf->lsa_changed = 1;
+      }
+      else {
+        link = &(nbr->next);
+      }
+    }
+
+    /* 4 So are the LSAs no longer refreshed */
+    struct sr_pwospf_router** rlink = &(ospf->lsdb);
+    while (*rlink) {
+      struct sr_pwospf_router* router = *rlink;
+      if (router->rid != ospf->rid &&
+          now - router->updated_ms > SR_PWOSPF_LSUINT * SR_PWOSPF_LSU_TIMEOUT_MULT * 1000) {
+        *rlink = router->next;
+        free(router->adv);
+        free(router);
+        ospf->spf_full = 1;
+        sr_pwospf_spf_schedule(sr, now);
+      }
+      else {
+        rlink = &(router->next);
+      }
+    }
+
+    /* 5 Flood our LSA when our links changed, or to refresh it */
+    if (ospf->lsa_changed || now >= ospf->next_lsu_ms) {
+      sr_pwospf_originate(sr, now, &outbox);
+    }
+
+    /* 6 Recompute the routes once the hold time is over */
+    if (ospf->spf_pending && now >= ospf->spf_due_ms) {
+      routes = sr_pwospf_spf(sr, &num_routes);
+    }
+    pthread_mutex_unlock(&(ospf->lock));
+
+    sr_pwospf_send(sr, outbox);
+    if (routes != NULL) {
+      sr_rt_sync(sr, routes, num_routes);
+      free(routes);
+      sr_print_routing_table(sr);
+      sr_print_stats(sr);
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_handle()
+ * @brief function handles a received PWOSPF packet: a hello refreshes, or
+ * discovers, a neighbor; a newer LSU updates the database and is flooded
+ * on
+ * @param sr: pointer to simple router state.
+ * @param packet: the Ethernet frame
+ * @param len: length of the IP packet in it
+ * @param if_name: interface it was received on
+ *---------------------------------------------------------------------*/
+void sr_pwospf_handle(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *if_name) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  struct sr_if* interface = sr_get_interface(sr, if_name);
+  sr_ip_hdr_t* ip = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  sr_ospf_hdr_t* ospf_hdr = (sr_ospf_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+  struct sr_packet* outbox = NULL;
+  unsigned int ospf_len;
+  uint64_t now = sr_now_ms();
+
+  if(ospf == NULL || interface == NULL || len < sizeof(sr_ip_hdr_t) + sizeof(sr_ospf_hdr_t)){
+    return;
+  }
+  ospf_len = ntohs(ospf_hdr->len);
+  pthread_mutex_lock(&(ospf->lock));
+  if(ospf_hdr->version != OSPF_V2 || ospf_len < sizeof(sr_ospf_hdr_t) ||
+     ospf_len > len - sizeof(sr_ip_hdr_t) || ospf_hdr->aid != htonl(SR_PWOSPF_AREA) ||
+     sr_pwospf_cksum(ospf_hdr, ospf_len) != ospf_hdr->csum ||
+     sr_pwospf_rid(sr) == 0 || ospf_hdr->rid == ospf->rid){
+    ospf->lsus_dropped += ospf_hdr->type == OSPF_TYPE_LSU;
+    pthread_mutex_unlock(&(ospf->lock));
+    return;
+  }
+
+  /* 1 Hello: the sender is a neighbor if it agrees on the link */
+  if(ospf_hdr->type == OSPF_TYPE_HELLO &&
+     ospf_len >= sizeof(sr_ospf_hdr_t) + sizeof(sr_ospf_hello_t)){
+    sr_ospf_hello_t* hello = (sr_ospf_hello_t *)(ospf_hdr + 1);
+    struct sr_pwospf_nbr* nbr;
+    if(hello->nmask == interface->mask && ntohs(hello->helloint) == SR_PWOSPF_HELLOINT){
+      ospf->hellos_rcvd++;
+      for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+        if(nbr->rid == ospf_hdr->rid && strcmp(nbr->interface, if_name) == 0){
+          break;
+        }
+      }
+      if(nbr == NULL){
+        nbr = (struct sr_pwospf_nbr*)calloc(1, sizeof(struct sr_pwospf_nbr));
+        assert(nbr);
+        nbr->rid = ospf_hdr->rid;
+        strncpy(nbr->interface, if_name, sr_IFACE_NAMELEN - 1);
+        nbr->next = ospf->nbrs;
+        ospf->nbrs = nbr;
+        ospf->lsa_changed = 1;
+        pthread_cond_signal(&(ospf->cond));
+        sr_bfd_add_session(sr, ip->ip_src, if_name);
+      }
+      nbr->ip = ip->ip_src;
+      nbr->last_hello_ms = now;
+    }
+  }
+  /* 2 LSU: keep and flood it on only if it is newer than what we have */
+  else if(ospf_hdr->type == OSPF_TYPE_LSU &&
+          ospf_len >= sizeof(sr_ospf_hdr_t) + sizeof(sr_ospf_lsu_t)){
+    sr_ospf_lsu_t* lsu = (sr_ospf_lsu_t *)(ospf_hdr + 1);
+    unsigned int num_adv = ntohl(lsu->num_adv);
+    uint16_t seq = ntohs(lsu->seq);
+    uint16_t ttl = ntohs(lsu->ttl);
+    struct sr_pwospf_router* router = sr_pwospf_lsdb_find(ospf, ospf_hdr->rid);
+
+    ospf->lsus_rcvd++;
+    if(num_adv > (ospf_len - sizeof(sr_ospf_hdr_t) - sizeof(sr_ospf_lsu_t)) / sizeof(sr_ospf_lsa_t) ||
+       (router != NULL && (int16_t)(seq - router->seq) <= 0)){
+      ospf->lsus_dropped++;
+    }
+    else{
+      if(sr_pwospf_lsdb_store(ospf, ospf_hdr->rid, seq, (sr_ospf_lsa_t *)(lsu + 1), num_adv, now)){
+        sr_pwospf_spf_schedule(sr, now);
+      }
+      if(ttl > 1){
+        sr_pwospf_flood(sr, sr_pwospf_lsdb_find(ospf, ospf_hdr->rid), ttl - 1, if_name, &outbox);
+        ospf->lsus_flooded++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&(ospf->lock));
+  sr_pwospf_send(sr, outbox);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_interface_event()
+ * @brief function reacts to an interface going up or down: the neighbors
+ * on a down interface are dropped, and our LSA is flooded again at once
+ * @param sr: pointer to simple router state.
+ * @param if_name: the interface
+ * @param status: 0 - interface down; 1 - interface up
+ *---------------------------------------------------------------------*/
+void sr_pwospf_interface_event(struct sr_instance *sr, const char *if_name, uint32_t status) {
+  struct sr_pwospf *ospf = sr->pwospf;
+
+  if(ospf == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(ospf->lock));
+  if(status == 0){
+    struct sr_pwospf_nbr** link = &(ospf->nbrs);
+    while(*link){
+      struct sr_pwospf_nbr* nbr = *link;
+      if(strcmp(nbr->interface, if_name) == 0){
+        *link = nbr->next;
+        free(nbr);
+      }
+      else{
+        link = &(nbr->next);
+      }
+    }
+  }
+  ospf->lsa_changed = 1;
+  pthread_cond_signal(&(ospf->cond));
+  pthread_mutex_unlock(&(ospf->lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_nbr_down()
+ * @brief function drops a neighbor the liveness detection lost, without
+ * waiting for its hellos to time out, and floods our LSA again at once
+ * @param sr: pointer to simple router state.
+ * @param ip: source of its hellos
+ * @param if_name: interface they are received on
+ *---------------------------------------------------------------------*/
+void sr_pwospf_nbr_down(struct sr_instance *sr, uint32_t ip, const char *if_name) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  struct sr_pwospf_nbr** link;
+
+  if(ospf == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(ospf->lock));
+  link = &(ospf->nbrs);
+  while(*link){
+    struct sr_pwospf_nbr* nbr = *link;
+    if(nbr->ip == ip && strcmp(nbr->interface, if_name) == 0){
+      *link = nbr->next;
+      free(nbr);
+      ospf->lsa_changed = 1;
+    }
+    else{
+      link = &(nbr->next);
+    }
+  }
+  pthread_cond_signal(&(ospf->cond));
+  pthread_mutex_unlock(&(ospf->lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pwospf_print_stats()
+ * @brief function prints the neighbors, the link state database and the
+ * PWOSPF counters
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_pwospf_print_stats(struct sr_instance *sr) {
+  struct sr_pwospf *ospf = sr->pwospf;
+  struct sr_pwospf_nbr* nbr;
+  struct sr_pwospf_router* router;
+  struct in_addr addr;
+  uint64_t now = sr_now_ms();
+  int b;
+
+  if(ospf == NULL){
+    return;
+  }
+  pthread_mutex_lock(&(ospf->lock));
+  addr.s_addr = ospf->rid;
+  printf("PWOSPF router %s, LSA seq %u\n", inet_ntoa(addr), ospf->seq);
+  for(nbr = ospf->nbrs; nbr; nbr = nbr->next){
+    addr.s_addr = nbr->rid;
+    printf("  neighbor %s on %s, ", inet_ntoa(addr), nbr->interface);
+    addr.s_addr = nbr->ip;
+    printf("at %s, heard %llu ms ago\n", inet_ntoa(addr),
+           (unsigned long long)(now - nbr->last_hello_ms));
+  }
+  for(router = ospf->lsdb; router; router = router->next){
+    addr.s_addr = router->rid;
+    printf("  LSA %s seq %u: %u links", inet_ntoa(addr), router->seq, router->num_adv);
+    if(router->dist != SR_PWOSPF_UNREACHED){
+      printf(", %u hops\n", router->dist);
+    }
+    else{
+      printf(", unreachable\n");
+    }
+  }
+  printf("PWOSPF hellos sent: %lu, received: %lu\n", ospf->hellos_sent, ospf->hellos_rcvd);
+  printf("PWOSPF LSUs sent: %lu, received: %lu, flooded: %lu, dropped: %lu\n",
+         ospf->lsus_sent, ospf->lsus_rcvd, ospf->lsus_flooded, ospf->lsus_dropped);
+  printf("SPF runs: %lu (%lu full), %lu LSA changes, %lu routers settled, avg %llu us, max %llu us\n",
+         ospf->spf_runs, ospf->spf_full_runs, ospf->spf_changes, ospf->spf_visits,
+         (unsigned long long)(ospf->spf_runs ? ospf->spf_us / ospf->spf_runs : 0),
+         (unsigned long long)ospf->spf_max_us);
+  printf("SPF run times, us:");
+  for(b = 0; b < SR_PWOSPF_SPF_HIST_BUCKETS; b++){
+    if(ospf->spf_hist[b] > 0){
+      if(b == SR_PWOSPF_SPF_HIST_BUCKETS - 1){
+        printf(" [%u,) %lu", (1u << b) - 1, ospf->spf_hist[b]);
+      }
+      else{
+        printf(" [%u,%u) %lu", (1u << b) - 1, (1u << (b + 1)) - 1, ospf->spf_hist[b]);
+      }
+    }
+  }
+  printf("\n");
+  pthread_mutex_unlock(&(ospf->lock));
+}
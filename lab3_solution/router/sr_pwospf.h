@@ -0,0 +1,125 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pwospf.h
+ *
+ * Description:
+ *
+ * PWOSPF, a link-state alternative to the RIP engine in sr_rt.c. Routers
+ * discover their neighbors with hellos, flood link state updates (LSUs)
+ * describing their links, and each runs Dijkstra over the resulting link
+ * state database. The shortest paths are written into the same routing
+ * table, and so the same FIB, that RIP maintains.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_PWOSPF_H
+#define sr_PWOSPF_H
+
+#ifdef _DARWIN_
+#include <sys/types.h>
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "sr_protocol.h"
+
+#define SR_PWOSPF_HELLOINT     1    /* seconds between hellos */
+#define SR_PWOSPF_DEAD_MULT    3    /* hellos missed before a neighbor is dead */
+#define SR_PWOSPF_LSUINT       10   /* seconds between LSU refreshes */
+#define SR_PWOSPF_LSU_TIMEOUT_MULT 3 /* refreshes missed before an LSA expires */
+#define SR_PWOSPF_LSU_TTL      64
+#define SR_PWOSPF_AREA         0
+#define SR_PWOSPF_SPF_HOLD_MS  50   /* LSA changes coalesced before an SPF run */
+#define SR_PWOSPF_SPF_HIST_BUCKETS 12 /* SPF run times, log2 microseconds */
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pwospf_nbr
+ *
+ * Neighbor heard on one of our interfaces
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pwospf_nbr
+{
+    uint32_t rid;
+    uint32_t ip; /* source of its hellos */
+    char interface[sr_IFACE_NAMELEN];
+    uint64_t last_hello_ms;
+    struct sr_pwospf_nbr* next;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pwospf_router
+ *
+ * Link state database entry: the last LSA of a router, and its place in
+ * the shortest path tree
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pwospf_router
+{
+    uint32_t rid;
+    uint16_t seq;
+    uint64_t updated_ms;
+    sr_ospf_lsa_t* adv;
+    unsigned int num_adv;
+    /* SPF, the tree is kept between runs and repaired incrementally */
+    uint32_t dist;
+    struct sr_pwospf_router* parent;
+    struct sr_pwospf_router* first_hop; /* neighbor of ours the path starts at */
+    int changed;  /* LSA changed since the last run */
+    int orphaned; /* 0 - unknown; 1 - path intact; 2 - path broken */
+    int queued;
+    struct sr_pwospf_router* next;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pwospf
+ *
+ * State of the PWOSPF engine
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pwospf
+{
+    pthread_mutex_t lock; /* guards everything below */
+    pthread_cond_t cond;  /* wakes the timer thread */
+    uint32_t rid;         /* 0 until the interfaces are known */
+    uint16_t seq;         /* of our own LSA */
+    struct sr_pwospf_nbr* nbrs;
+    struct sr_pwospf_router* lsdb; /* our own LSA included */
+    int lsa_changed;      /* our links changed, flood a new LSA */
+    int spf_pending;      /* the database changed, recompute */
+    int spf_full;         /* routers left the database, recompute from scratch */
+    uint64_t spf_due_ms;  /* when the pending recomputation runs */
+    struct sr_pwospf_router** open; /* SPF candidates */
+    unsigned int open_len;
+    unsigned int open_max;
+    uint64_t next_hello_ms;
+    uint64_t next_lsu_ms;
+    unsigned long hellos_sent;
+    unsigned long hellos_rcvd;
+    unsigned long lsus_sent;
+    unsigned long lsus_rcvd;
+    unsigned long lsus_flooded; /* received and sent on */
+    unsigned long lsus_dropped; /* old, looped or malformed */
+    unsigned long spf_runs;
+    unsigned long spf_full_runs;
+    unsigned long spf_changes;  /* LSA changes, coalesced into spf_runs */
+    unsigned long spf_visits;   /* routers settled, over all runs */
+    uint64_t spf_us;
+    uint64_t spf_max_us;
+    unsigned long spf_hist[SR_PWOSPF_SPF_HIST_BUCKETS];
+};
+
+void sr_pwospf_init(struct sr_instance*);
+void *sr_pwospf_timeout(void *);
+void sr_pwospf_handle(struct sr_instance*, uint8_t *, unsigned int, char *);
+void sr_pwospf_interface_event(struct sr_instance*, const char *, uint32_t);
+void sr_pwospf_nbr_down(struct sr_instance*, uint32_t, const char *);
+void sr_pwospf_print_stats(struct sr_instance*);
+
+#endif /* -- sr_PWOSPF_H -- */
@@ -23,6 +23,8 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_pwospf.h"
+#include "sr_bfd.h"
 #include "vnscommand.h"
 
 
@@ -41,6 +43,10 @@ void sr_init(struct sr_instance* sr)
 
   /* Initialize cache and cache cleanup thread */
   sr_arpcache_init(&(sr->cache));
+  sr->cache.neg_hold = sr->arp_neg_hold;
+  sr->cache.q_max_bytes = sr->arpq_max_bytes;
+  sr->cache.q_max_iface_bytes = sr->arpq_max_iface_bytes;
+  sr->cache.q_drop_policy = sr->arpq_drop_policy;
 
   pthread_attr_init(&(sr->attr));
   pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
@@ -50,20 +56,69 @@ void sr_init(struct sr_instance* sr)
 
   pthread_create(&arp_thread, &(sr->attr), sr_arpcache_timeout, sr);
 
+  /* The calling thread runs the read loop and forwards packets */
+  sr->fib_reader = sr_fib_register_reader(&(sr->fib));
+  sr_fib_online(&(sr->fib), sr->fib_reader);
+
   srand(time(NULL));
   pthread_mutexattr_init(&(sr->rt_lock_attr));
   pthread_mutexattr_settype(&(sr->rt_lock_attr), PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&(sr->rt_lock), &(sr->rt_lock_attr));
 
+  pthread_condattr_t rip_timer_cond_attr;
+  pthread_condattr_init(&rip_timer_cond_attr);
+  pthread_condattr_setclock(&rip_timer_cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&(sr->rip_timer_cond), &rip_timer_cond_attr);
+  pthread_condattr_destroy(&rip_timer_cond_attr);
+  pthread_mutex_init(&(sr->rip_timer_lock), NULL);
+  sr->rip_trigger_at = 0;
+  sr->rip_triggers_sent = 0;
+  sr->rip_triggers_suppressed = 0;
+  sr->nh_stats = 0;
+  pthread_mutex_init(&(sr->nh_stats_lock), NULL);
+
   pthread_attr_init(&(sr->rt_attr));
   pthread_attr_setdetachstate(&(sr->rt_attr), PTHREAD_CREATE_JOINABLE);
   pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
   pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
-  pthread_t rt_thread;
-  pthread_create(&rt_thread, &(sr->rt_attr), sr_rip_timeout, sr);
+  if(sr->bfd_interval_ms != 0){
+    sr_bfd_init(sr);
+  }
+  if(sr->routing_protocol == routing_pwospf){
+    sr_pwospf_init(sr);
+  }
+  else{
+    pthread_t rt_thread;
+    pthread_create(&rt_thread, &(sr->rt_attr), sr_rip_timeout, sr);
+  }
 
 } 
 
+/*---------------------------------------------------------------------
+ * Method: sr_print_stats(void)
+ * Scope:  Global
+ *
+ * Print the counters kept by the router subsystems
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_print_stats(struct sr_instance* sr)
+{
+  assert(sr);
+
+  printf("  <---------- Router Stats ---------->\n");
+  sr_arpcache_print_stats(&(sr->cache));
+  if(sr->routing_protocol == routing_pwospf){
+    sr_pwospf_print_stats(sr);
+  }
+  else{
+    sr_rip_print_stats(sr);
+  }
+  sr_bfd_print_stats(sr);
+  sr_fib_print_stats(&(sr->fib));
+  sr_nh_print_stats(sr);
+}
+
 /*---------------------------------------------------------------------
  * Method: sr_handlepacket
  * Scope:  Global
@@ -150,6 +205,83 @@ void send_arp_req(struct sr_instance* sr, struct sr_if* iface, uint32_t ipadress
 
 
 
+/*---------------------------------------------------------------------
+ * Method: sr_flow_hash() 
+ * @brief function hashes the 5-tuple of a packet (addresses, protocol and,
+ * for unfragmented TCP/UDP, ports), so every packet of a flow picks the
+ * same equal-cost next hop.
+ * @param ip: the IP header
+ * @param len: length of the IP packet
+ *---------------------------------------------------------------------*/
+static uint32_t sr_flow_hash(sr_ip_hdr_t* ip, unsigned int len){
+  uint32_t h = 2166136261u; /* FNV-1a */
+  uint8_t key[13];
+  unsigned int key_len = 9, i;
+  unsigned int hl = ip->ip_hl * 4;
+
+  memcpy(key, &ip->ip_src, 4);
+  memcpy(key + 4, &ip->ip_dst, 4);
+  key[8] = ip->ip_p;
+  if((ip->ip_p == ip_protocol_tcp || ip->ip_p == ip_protocol_udp) &&
+     (ntohs(ip->ip_off) & IP_OFFMASK) == 0 && len >= hl + 4){
+    memcpy(key + 9, (uint8_t*)ip + hl, 4);
+    key_len = 13;
+  }
+  for(i = 0; i < key_len; i++){
+    h ^= key[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_nh_account() 
+ * @brief function counts a packet forwarded to a next hop
+ * @param sr: pointer to simple router state.
+ * @param gw: the next hop, 0 for direct delivery
+ * @param if_name: the outgoing interface
+ * @param bytes: size of the IP packet
+ *---------------------------------------------------------------------*/
+void sr_nh_account(struct sr_instance* sr, uint32_t gw, const char* if_name, unsigned int bytes){
+  struct sr_nh_stat* stat;
+
+  pthread_mutex_lock(&(sr->nh_stats_lock));
+  for(stat = sr->nh_stats; stat; stat = stat->next){
+    if(stat->gw == gw && strcmp(stat->interface, if_name) == 0){
+      break;
+    }
+  }
+  if(stat == NULL){
+    stat = (struct sr_nh_stat*)calloc(1, sizeof(struct sr_nh_stat));
+    assert(stat);
+    stat->gw = gw;
+    strncpy(stat->interface, if_name, sr_IFACE_NAMELEN - 1);
+    stat->next = sr->nh_stats;
+    sr->nh_stats = stat;
+  }
+  stat->packets++;
+  stat->bytes += bytes;
+  pthread_mutex_unlock(&(sr->nh_stats_lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_nh_print_stats() 
+ * @brief function prints the per next hop forwarding counters
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_nh_print_stats(struct sr_instance* sr){
+  struct sr_nh_stat* stat;
+  struct in_addr gw;
+
+  pthread_mutex_lock(&(sr->nh_stats_lock));
+  for(stat = sr->nh_stats; stat; stat = stat->next){
+    gw.s_addr = stat->gw;
+    printf("Next hop %s on %s: %lu packets, %lu bytes\n",
+           inet_ntoa(gw), stat->interface, stat->packets, stat->bytes);
+  }
+  pthread_mutex_unlock(&(sr->nh_stats_lock));
+}
+
 /*---------------------------------------------------------------------
  * Method: sr_handle_ip() 
  * IP Stack Level: Network Layer
@@ -175,9 +307,29 @@ void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char*
   }
   ip->ip_sum = calc; 
 
+  /* PWOSPF is link-local, never forwarded */
+  if(ip->ip_p == ip_protocol_ospf){
+    if(sr->routing_protocol == routing_pwospf){
+      sr_pwospf_handle(sr, buf, len, interface);
+    }
+    return;
+  }
+
+  /* BFD control packets are for us, from a directly connected neighbor */
+  if(ip->ip_p == ip_protocol_udp && len >= sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t) &&
+     ((sr_udp_hdr_t*)(ip + 1))->port_dst == htons(BFD_PORT)){
+    if(is_own_ip(sr, ip) == 1){
+      sr_bfd_handle(sr, buf, len, interface);
+      return;
+    }
+  }
+
   if(ip->ip_dst==broadcast_ip){
     sr_udp_hdr_t* udp = (sr_udp_hdr_t*) (buf+sizeof(sr_ip_hdr_t)+sizeof(sr_ethernet_hdr_t));
     if(udp->port_src==520 && udp->port_dst==520){
+      if(sr->routing_protocol != routing_rip){
+        return;
+      }
       /* send rip packet*/
       sr_rip_pkt_t* rip = (sr_rip_pkt_t*) (buf+sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)+sizeof(sr_ethernet_hdr_t));
 
@@ -237,7 +389,12 @@ void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char*
           /* End TODO */
         }
         else{
-          if(sr_obtain_interface_status(sr,match->interface)!=0){
+          /* Spread flows over the route's equal-cost next hops */
+          struct in_addr out_gw;
+          char* out_iface;
+          sr_rt_select_path(match, sr_flow_hash(ip, len), &out_gw, &out_iface);
+          if(sr_obtain_interface_status(sr,out_iface)!=0){
+            sr_nh_account(sr, out_gw.s_addr, out_iface, ntohs(ip->ip_len));
             /*2.c.3.i Decrement TTL*/
             ip -> ip_ttl -= 1;
             
@@ -252,13 +409,13 @@ void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char*
             /*Get the source interface record*/
             struct sr_if *srcMac = sr_get_interface(sr, interface); 
             /*Get the forwarding interface record*/
-            struct sr_if *iface2 = sr_get_interface(sr, match->interface); 
+            struct sr_if *iface2 = sr_get_interface(sr, out_iface); 
             sr_ethernet_hdr_t* start_of_pckt = (sr_ethernet_hdr_t*) block;
             struct sr_arpentry * entry;
             /*indirect delivery*/
-            if(match->gw.s_addr != 0){
+            if(out_gw.s_addr != 0){
               /* Lab4-Task2 TODO: find the MAC addr in arp cache of the next hop ip */
-              entry = sr_arpcache_lookup(&(sr->cache), match->gw.s_addr); 
+              entry = sr_arpcache_lookup(&(sr->cache), out_gw.s_addr); 
               /* End TODO */
             }
             /*direct delivery, the destination is on the same network as the sending host*/
@@ -278,7 +435,7 @@ void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char*
                 memcpy((void *) (start_of_pckt->ether_dhost), entry->mac, sizeof(uint8_t) * ETHER_ADDR_LEN);
               }
               start_of_pckt->ether_type = htons(ethertype_ip);
-              sr_send_packet(sr, block, ntohs(ip->ip_len) + sizeof(sr_ethernet_hdr_t), match->interface);
+              sr_send_packet(sr, block, ntohs(ip->ip_len) + sizeof(sr_ethernet_hdr_t), out_iface);
               free(block);
             }
             /*Ideally, you should find the Destination MAC Address in your ARP cache using the 
@@ -292,17 +449,32 @@ void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char*
             
             /*2.c.3.iii(2) arp cache did not contain dest IP, send arp request to find the MAC address*/
             else  { 
-              /*direct delivery*/
-              if(match->gw.s_addr == 0){ 
-                sr_arpcache_queuereq(&sr->cache, ip->ip_dst, (uint8_t *) block, ntohs(ip->ip_len) + sizeof(sr_ethernet_hdr_t), match->interface);
-              }
-              /*indirect delivery*/ 
-              else{ 
-                sr_arpcache_queuereq(&sr->cache, match->gw.s_addr, (uint8_t *) block, ntohs(ip->ip_len) + sizeof(sr_ethernet_hdr_t), match->interface);
+              /* Resolve the next hop (the gateway for indirect delivery), on the
+                 interface the route selected. Only the first miss for a
+                 (next hop, interface) pair sends a request; later misses just
+                 join its queue and the sweep thread paces retransmissions. */
+              uint32_t next_hop = (out_gw.s_addr != 0) ? out_gw.s_addr : ip->ip_dst;
+              /* A next hop that recently failed to resolve is held in the
+                 negative cache: answer (rate limited) or drop, never queue. */
+              int neg = sr_arpcache_check_negative(&sr->cache, next_hop);
+              if (neg != 0) {
+                if (neg == 1) {
+                  icmp_unreachable(sr, Unreachable_host_code, ip, interface);
+                }
+                free(block);
+                return;
               }
+              pthread_mutex_lock(&(sr->cache.lock));
+              struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, next_hop, (uint8_t *) block, ntohs(ip->ip_len) + sizeof(sr_ethernet_hdr_t), out_iface);
               /* Lab4-Task2 TODO: Send an ARP request to the out interface */
-              send_arp_req(sr, iface2, ip->ip_dst, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t));
+              if (req->times_sent == 0) {
+                handle_arpreq(sr, req);
+              }
+              else {
+                sr->cache.reqs_suppressed++;
+              }
               /* End TODO */
+              pthread_mutex_unlock(&(sr->cache.lock));
               free(block);
             }      
             
@@ -389,28 +561,9 @@ void icmp_time(struct sr_instance * sr, uint8_t type, uint8_t code, sr_ip_hdr_t
  * @param addr: ip destination address. 
  */
 struct sr_rt *prefix_match(struct sr_instance * sr, uint32_t addr){
-  struct sr_rt * table = sr->routing_table;
-  int max_len = -1;
-  struct sr_rt * ans = NULL;
-
-  while (table != NULL) {
-    in_addr_t left = (table->mask.s_addr & addr);
-    in_addr_t right = (table->dest.s_addr & table->mask.s_addr);
-    if (left == right && table->metric < INFINITY) {
-      uint8_t size = 0;
-      uint32_t checker = 1 << 31;
-      while ((checker != 0) && ((checker & table->mask.s_addr) != 0)) {
-        size++;
-        checker = checker >> 1;
-      }
-      if (size > max_len) {
-        max_len = size;
-        ans = table;
-      }
-    }
-    table = table->next;
-  }
-  return ans;
+  /* Lock-free lookup in the published forwarding table; the route stays
+     valid until the packet thread goes back to recv() */
+  return sr_fib_lookup(&(sr->fib), addr);
 }
 
 
@@ -613,21 +766,11 @@ void sr_handle_arp(struct sr_instance* sr, uint8_t * buf, unsigned int len, char
     
     /*1.a.1 Insert the Sender MAC in this packet to your ARP cache*/
     /* Lab4-Task2 TODO: Insert (sender MAC, sender ip) to ARP cache */
-    struct sr_arpreq * pending = sr_arpcache_insert(&sr->cache, arp->ar_sha, arp->ar_sip); 
+    struct sr_arpreq * pending = sr_arpcache_insert(&sr->cache, arp->ar_sha, arp->ar_sip, interface); 
     /* End TODO */ 
     /*1.a.1i If pending is happening in request, send pending request one by one */ 
     if (pending) {
-      struct sr_packet *current = pending->packets;
-      while (current) { 
-        uint8_t *packet = current->buf;
-        sr_ethernet_hdr_t *curheader = (sr_ethernet_hdr_t *)packet;
-        memcpy(curheader->ether_dhost, arp->ar_sha, ETHER_ADDR_LEN);
-        memcpy(curheader->ether_shost, iface->addr, ETHER_ADDR_LEN);
-        curheader->ether_type = htons(ethertype_ip);
-        sr_send_packet(sr, packet, current->len, interface);
-        current = current->next;
-      }
-      sr_arpreq_destroy(&(sr->cache), pending);
+      sr_flush_pending(sr, pending, arp->ar_sha, interface);
     }
   
     /*1.a.2 Send reply to the request*/
@@ -637,25 +780,42 @@ void sr_handle_arp(struct sr_instance* sr, uint8_t * buf, unsigned int len, char
   if(op==arp_op_reply){
     /* 1.b.1 Insert the Target MAC to your ARP cache*/
     /* Lab4-Task2 TODO: Insert (MAC, ip) included in the reply into ARP cache */
-    struct sr_arpreq * pending = sr_arpcache_insert(&sr->cache, arp->ar_sha, arp->ar_sip);
+    struct sr_arpreq * pending = sr_arpcache_insert(&sr->cache, arp->ar_sha, arp->ar_sip, interface);
     /* End TODO */
     /* 1.b.1.i pending is happening in reply*/
     if (pending) {
-      struct sr_packet *current = pending->packets;
-      while (current!=NULL) { 
-        uint8_t *packet = current->buf;
-        sr_ethernet_hdr_t *curheader = (sr_ethernet_hdr_t *)packet;
-        memcpy(curheader->ether_dhost, arp->ar_sha, ETHER_ADDR_LEN);
-        memcpy(curheader->ether_shost, iface->addr, ETHER_ADDR_LEN);
-        curheader->ether_type = htons(ethertype_ip);
-        sr_send_packet(sr, packet, current->len, interface);
-        current = current->next;
-      }
-      sr_arpreq_destroy(&(sr->cache), pending);
+      sr_flush_pending(sr, pending, arp->ar_sha, interface);
     }
   }
 }
 
+/**
+ * sr_flush_pending()
+ * IP Stack Level: Link Layer 
+ * @brief Function releases the packets that were waiting on a resolved ARP
+ * request as one batch: Ethernet headers are rewritten in place, the whole
+ * backlog goes out in vectored writes, then the request is destroyed.
+ * @param sr: pointer to simple router state.
+ * @param pending: the resolved request, already off the request queue.
+ * @param mac: the resolved hardware address.
+ * @param interface: interface the packets go out on. 
+ */
+void sr_flush_pending(struct sr_instance* sr, struct sr_arpreq* pending, unsigned char* mac, char* interface) {
+  struct sr_if* iface = sr_get_interface(sr, interface);
+  struct sr_packet *current;
+
+  for (current = pending->packets; current != NULL; current = current->next) {
+    sr_ethernet_hdr_t *curheader = (sr_ethernet_hdr_t *)current->buf;
+    memcpy(curheader->ether_dhost, mac, ETHER_ADDR_LEN);
+    memcpy(curheader->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    curheader->ether_type = htons(ethertype_ip);
+  }
+  if (pending->packets) {
+    sr_send_packet_batch(sr, pending->packets, interface);
+  }
+  sr_arpreq_destroy(&(sr->cache), pending);
+}
+
 /*---------------------------------------------------------------------
  * Method: send_arp_rep() 
  * IP Stack Level: Link Layer
@@ -694,3 +854,109 @@ void send_arp_rep(struct sr_instance* sr, struct sr_if* iface, sr_arp_hdr_t* arp
   free(block);
   return;
 }
+
+/*---------------------------------------------------------------------
+ * Method: send_arp_announce() 
+ * IP Stack Level: Link Layer
+ * @brief function broadcasts a gratuitous ARP reply for an interface, so
+ * neighbors learn its IP->MAC mapping before any traffic needs it 
+ * @param sr: pointer to simple router state.
+ * @param iface: record of the interface to announce 
+ * *
+ *---------------------------------------------------------------------*/
+void send_arp_announce(struct sr_instance* sr, struct sr_if* iface){
+  unsigned int len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
+  uint8_t *block = (uint8_t *) malloc(len);
+  memset(block, 0, sizeof(uint8_t) * len);
+  sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)block;
+  sr_arp_hdr_t *arp_hdr = (sr_arp_hdr_t*)(block+sizeof(sr_ethernet_hdr_t));
+
+  memcpy(ethernet_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+  memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+  ethernet_hdr->ether_type = htons(ethertype_arp);
+
+  /* Sender and target are both us: a reply is accepted by every receiver,
+     while a request would be dropped as not addressed to them */
+  arp_hdr->ar_hrd = htons(arp_hrd_ethernet);
+  arp_hdr->ar_pro = htons(ethertype_ip);
+  arp_hdr->ar_hln = ETHER_ADDR_LEN;
+  arp_hdr->ar_pln = sizeof(uint32_t);
+  arp_hdr->ar_op = htons(arp_op_reply);
+  memcpy(arp_hdr->ar_sha, iface->addr, ETHER_ADDR_LEN);
+  arp_hdr->ar_sip = iface->ip;
+  memcpy(arp_hdr->ar_tha, iface->addr, ETHER_ADDR_LEN);
+  arp_hdr->ar_tip = iface->ip;
+
+  sr_send_packet(sr, block, len, iface->name);
+  free(block);
+}
+
+/**
+ * sr_arp_prime()
+ * IP Stack Level: Link Layer
+ * @brief Function starts resolving an IP on an interface before any packet
+ * needs it. Nothing is sent if the IP is cached, held as unresolvable, or
+ * already being resolved.
+ * @param sr: pointer to simple router state.
+ * @param ip: IP to resolve, network byte order.
+ * @param interface: name of the interface the IP is reached through.
+ */
+void sr_arp_prime(struct sr_instance* sr, uint32_t ip, char* interface){
+  struct sr_arpentry *entry = sr_arpcache_lookup(&(sr->cache), ip);
+  if (entry) {
+    free(entry);
+    return;
+  }
+  pthread_mutex_lock(&(sr->cache.lock));
+  if (!sr_arpcache_is_negative(&sr->cache, ip)) {
+    struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, ip, NULL, 0, interface);
+    if (req->times_sent == 0) {
+      handle_arpreq(sr, req);
+    }
+  }
+  pthread_mutex_unlock(&(sr->cache.lock));
+}
+
+/**
+ * sr_arp_warmup()
+ * IP Stack Level: Link Layer
+ * @brief Function runs the optional ARP warm-up once the interfaces are
+ * known: announces every interface and starts resolving each host listed
+ * in the warm-up file (one IP per line) through its current route.
+ * @param sr: pointer to simple router state.
+ */
+void sr_arp_warmup(struct sr_instance* sr){
+  struct sr_if *iface;
+  for (iface = sr->if_list; iface != NULL; iface = iface->next) {
+    send_arp_announce(sr, iface);
+  }
+
+  if (sr->arp_warmup_hosts == NULL) {
+    return;
+  }
+  FILE *fp = fopen(sr->arp_warmup_hosts, "r");
+  if (fp == NULL) {
+    perror("unable to read ARP warm-up host list");
+    return;
+  }
+  char line[BUFSIZ];
+  char host[32];
+  while (fgets(line, BUFSIZ, fp) != 0) {
+    struct in_addr addr;
+    if (sscanf(line, "%31s", host) != 1 || host[0] == '#') {
+      continue;
+    }
+    if (inet_aton(host, &addr) == 0) {
+      fprintf(stderr, "ARP warm-up: cannot convert %s to valid IP\n", host);
+      continue;
+    }
+    struct sr_rt *match = prefix_match(sr, addr.s_addr);
+    if (match == NULL) {
+      fprintf(stderr, "ARP warm-up: no route to %s yet, skipping\n", host);
+      continue;
+    }
+    uint32_t next_hop = (match->gw.s_addr != 0) ? match->gw.s_addr : addr.s_addr;
+    sr_arp_prime(sr, next_hop, match->interface);
+  }
+  fclose(fp);
+}
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_fib.h"
 
 void sr_handle_ip(struct sr_instance* sr, uint8_t * buf, unsigned int len,char* interface);
 struct sr_rt *prefix_match(struct sr_instance * sr, uint32_t addr);
@@ -25,8 +26,12 @@ void sr_icmp_echo(struct sr_instance* sr, uint8_t type, uint8_t code, sr_ip_hdr_
 int is_own_ip(struct sr_instance* sr, sr_ip_hdr_t* current);
 void sr_handle_arp(struct sr_instance* sr, uint8_t * buf, unsigned int len, char* interface);
 void send_arp_rep(struct sr_instance* sr, struct sr_if* iface, sr_arp_hdr_t* arp);
+void sr_flush_pending(struct sr_instance* sr, struct sr_arpreq* pending, unsigned char* mac, char* interface);
 void icmp_time(struct sr_instance * sr, uint8_t type, uint8_t code, sr_ip_hdr_t * ip, char* interface);
 void send_arp_req(struct sr_instance* sr, struct sr_if* iface, uint32_t ipadress,unsigned int len);
+void send_arp_announce(struct sr_instance* sr, struct sr_if* iface);
+void sr_arp_prime(struct sr_instance* sr, uint32_t ip, char* interface);
+void sr_arp_warmup(struct sr_instance* sr);
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -41,10 +46,30 @@ void send_arp_req(struct sr_instance* sr, struct sr_if* iface, uint32_t ipadress
 
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
+#define SR_RT_HASH_SIZE 256 /* buckets in the (prefix, mask) route index */
+#define SR_RIP_JITTER_BUCKETS 10 /* histogram of regular update intervals */
 
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_pwospf;
+struct sr_bfd;
+
+/* Routing protocol filling the routing table */
+enum sr_routing_protocol {
+    routing_rip,
+    routing_pwospf
+};
+
+/* Packets forwarded to one next hop */
+struct sr_nh_stat
+{
+    uint32_t gw; /* 0 for direct delivery */
+    char interface[sr_IFACE_NAMELEN];
+    unsigned long packets;
+    unsigned long bytes;
+    struct sr_nh_stat* next;
+};
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -63,12 +88,74 @@ struct sr_instance
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_rt* rt_tail; /* last entry of routing_table, for appends */
+    struct sr_rt* rt_hash[SR_RT_HASH_SIZE]; /* routing table indexed by prefix */
+    struct sr_rt_slab* rt_slabs; /* storage for routing entries */
+    struct sr_rt* rt_free; /* unused entries, linked through next */
+    unsigned long rt_count; /* entries in routing_table */
+    unsigned long rt_slab_count;
+    unsigned long rt_flushed; /* unreachable routes garbage collected */
+    unsigned int rip_flush_secs; /* unreachable route lifetime, 0 keeps them */
+    unsigned long rt_if_events; /* interface up/down events handled */
+    struct sr_rip_nbr* rip_nbrs; /* RIP neighbor table */
+    unsigned long rip_nbr_expiries;
+    unsigned long rip_dup_skips; /* responses skipped by digest */
+    unsigned long rt_failovers; /* routes switched to their backup path */
+    unsigned int rip_damp_half_life_ms; /* 0 disables flap damping */
+    unsigned int rip_damp_suppress;
+    unsigned int rip_damp_reuse;
+    unsigned long rt_damp_flaps;
+    unsigned long rt_damp_suppressions;
+    unsigned long rip_tmpl_builds; /* per-interface RIP responses rebuilt */
+    unsigned long rip_tmpl_reuses; /* and sent from the template as is */
+    struct sr_rip_aggregate* rip_aggregates; /* per-interface aggregate ranges */
+    int rip_auto_summary; /* merge sibling prefixes with the same next hop */
+    struct sr_rip_import* rip_imports; /* per-interface import policies */
+    unsigned long rip_sum_routes; /* routes put through summarization, */
+    unsigned long rip_sum_entries; /* and the entries advertised for them */
+    uint32_t rt_seq; /* bumped on every advertised routing table change */
+    uint32_t rt_backup_gen; /* bumped on every backup path change, which rt_seq misses */
+    uint32_t rt_sync_gen; /* sr_rt_sync() passes */
+    enum sr_routing_protocol routing_protocol;
+    struct sr_pwospf* pwospf; /* PWOSPF engine, NULL when running RIP */
+    unsigned int pwospf_spf_hold_ms; /* LSA changes coalesced before an SPF run */
+    struct sr_bfd* bfd; /* neighbor liveness detection, NULL when disabled */
+    unsigned int bfd_interval_ms; /* its TX interval, 0 disables it */
+    unsigned int bfd_detect_mult;
+    struct sr_fib_state fib; /* lock-free copy of routing_table for forwarding */
+    struct sr_fib_reader* fib_reader; /* the packet thread's FIB reader */
+    struct sr_nh_stat* nh_stats; /* per next hop forwarding counters */
+    pthread_mutex_t nh_stats_lock;
+    uint32_t rip_trigger_seq; /* rt_seq covered by the last update sent */
     struct sr_if_status_cache * if_cache; /* interfaces' status cache*/
     pthread_mutex_t rt_lock; 
     pthread_mutexattr_t rt_lock_attr;
     pthread_mutex_t rt_locker;
     pthread_mutexattr_t rt_locker_attr;
+    unsigned int rt_lock_depth; /* recursion depth of the rt_locker owner */
+    uint64_t rt_lock_since_us; /* when the owner took rt_locker */
+    unsigned long rt_lock_holds; /* rt_locker hold time statistics */
+    uint64_t rt_lock_hold_us;
+    uint64_t rt_lock_hold_max_us;
+    pthread_mutex_t rip_send_lock; /* serializes RIP responses and templates */
+    pthread_mutex_t rip_timer_lock; /* guards the RIP timer state below */
+    pthread_cond_t rip_timer_cond;
+    uint64_t rip_trigger_at; /* when the pending triggered update fires, 0 = none */
+    unsigned int rip_trigger_min_ms; /* triggered update hold-down window */
+    unsigned int rip_trigger_max_ms;
+    unsigned int rip_update_ms; /* regular update period */
+    unsigned int rip_jitter_ms; /* and its random jitter, at most half of it */
+    unsigned long rip_jitter_hist[SR_RIP_JITTER_BUCKETS]; /* intervals across period +/- jitter */
+    unsigned long rip_jitter_late; /* intervals longer than period + jitter */
+    unsigned long rip_triggers_sent;
+    unsigned long rip_triggers_suppressed; /* changes folded into a pending update */
     struct sr_arpcache cache;   /* ARP cache */
+    double arp_neg_hold; /* seconds to hold unresolvable IPs, 0 disables */
+    unsigned long arpq_max_bytes; /* budget for frames parked on ARP */
+    unsigned long arpq_max_iface_bytes; /* same, per egress interface */
+    enum sr_arpq_drop_policy arpq_drop_policy;
+    int arp_warmup; /* resolve neighbors ahead of traffic */
+    const char* arp_warmup_hosts; /* extra hosts to resolve at startup */
     pthread_attr_t attr;
     pthread_attr_t rt_attr;
     FILE* logfile;
@@ -79,12 +166,16 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_batch(struct sr_instance* , struct sr_packet* , const char*);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_print_stats(struct sr_instance* );
+void sr_nh_account(struct sr_instance* , uint32_t , const char* , unsigned int );
+void sr_nh_print_stats(struct sr_instance* );
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
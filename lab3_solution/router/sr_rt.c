@@ -13,6 +13,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
+#include <stddef.h>
 
 
 #include <sys/socket.h>
@@ -24,6 +26,94 @@
 #include "sr_if.h"
 #include "sr_utils.h"
 #include "sr_router.h"
+#include "sr_bfd.h"
+
+static struct sr_rt* sr_rt_alloc(struct sr_instance* sr);
+static void sr_rt_free(struct sr_instance* sr, struct sr_rt* entry);
+static void sr_rip_send_full(struct sr_instance *sr, struct sr_if *only);
+
+/* Copy of the advertised routing table, taken under rt_locker and used
+   without it */
+struct sr_rt_snapshot
+{
+  struct sr_rt* entries;
+  unsigned int len;
+  uint32_t seq; /* sr->rt_seq the copy reflects */
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_lock() 
+ * @brief function takes rt_locker and, on the outermost acquisition,
+ * starts timing how long it is held.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_rt_lock(struct sr_instance* sr)
+{
+  pthread_mutex_lock(&(sr->rt_locker));
+  if(sr->rt_lock_depth++ == 0){
+    sr->rt_lock_since_us = sr_now_us();
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_unlock() 
+ * @brief function releases rt_locker and, on the outermost release,
+ * publishes a new forwarding table if the routing table changed and
+ * accounts for the hold time.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_rt_unlock(struct sr_instance* sr)
+{
+  /* Republish the forwarding table once the outermost writer is done */
+  if(sr->rt_lock_depth == 1 && !sr_fib_is_current(&(sr->fib), sr->rt_seq)){
+    sr_fib_publish(&(sr->fib), sr->routing_table, sr->rt_seq);
+  }
+  if(--sr->rt_lock_depth == 0){
+    uint64_t held = sr_now_us() - sr->rt_lock_since_us;
+    sr->rt_lock_holds++;
+    sr->rt_lock_hold_us += held;
+    if(held > sr->rt_lock_hold_max_us){
+      sr->rt_lock_hold_max_us = held;
+    }
+  }
+  pthread_mutex_unlock(&(sr->rt_locker));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_take_snapshot() 
+ * @brief function copies the routes changed after since_seq, so they can
+ * be serialized or printed once rt_locker is released.
+ * @param sr: pointer to simple router state.
+ * @param since_seq: only routes with a later change_seq are copied, 0 = all
+ * @param snap: filled in, release with sr_rt_free_snapshot()
+ *---------------------------------------------------------------------*/
+static void sr_rt_take_snapshot(struct sr_instance* sr, uint32_t since_seq,
+    struct sr_rt_snapshot* snap)
+{
+  struct sr_rt* rt_walker;
+
+  sr_rt_lock(sr);
+  snap->entries = (struct sr_rt*)malloc((sr->rt_count + 1) * sizeof(struct sr_rt));
+  assert(snap->entries);
+  snap->len = 0;
+  snap->seq = sr->rt_seq;
+  for(rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next){
+    if(rt_walker->change_seq > since_seq){
+      snap->entries[snap->len] = *rt_walker;
+      snap->entries[snap->len].next = NULL;
+      snap->entries[snap->len].hash_next = NULL;
+      snap->len++;
+    }
+  }
+  sr_rt_unlock(sr);
+}
+
+static void sr_rt_free_snapshot(struct sr_rt_snapshot* snap)
+{
+  free(snap->entries);
+  snap->entries = NULL;
+  snap->len = 0;
+}
 
 /*---------------------------------------------------------------------
  * Method: sr_load_rt() 
@@ -81,7 +171,21 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     }
     if( clear_routing_table == 0 ){
       printf("Loading routing table from server, clear local routing table.\n");
-      sr->routing_table = 0;
+      sr_rt_lock(sr);
+      while(sr->routing_table){
+        struct sr_rt* rt_next = sr->routing_table->next;
+        sr_rt_free(sr, sr->routing_table);
+        sr->routing_table = rt_next;
+      }
+      sr->rt_tail = 0;
+      sr->rt_count = 0;
+      struct sr_rip_nbr* nbr;
+      for(nbr = sr->rip_nbrs; nbr; nbr = nbr->next){
+        nbr->num_routes = 0;
+      }
+      memset(sr->rt_hash, 0, sizeof(sr->rt_hash));
+      sr->rt_seq++;
+      sr_rt_unlock(sr);
       clear_routing_table = 1;
     }
     sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,(uint32_t)0,iface);
@@ -115,6 +219,85 @@ int sr_build_rt(struct sr_instance* sr){
 }
 
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_hash() 
+ * @brief function hashes a (prefix, mask) pair into a bucket of sr->rt_hash
+ * @param dest: destination ip, host bits are ignored
+ * @param mask: network mask
+ * @return: bucket index
+ *---------------------------------------------------------------------*/
+static unsigned int sr_rt_hash(uint32_t dest, uint32_t mask)
+{
+  uint32_t h = (dest & mask) ^ (mask * 0x9e3779b1u);
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h % SR_RT_HASH_SIZE;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_lookup_prefix() 
+ * @brief function finds the routing entry for exactly this prefix and
+ * mask. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param dest: destination ip, host bits are ignored
+ * @param mask: network mask
+ * @return: the routing entry, NULL if there is none
+ *---------------------------------------------------------------------*/
+struct sr_rt* sr_rt_lookup_prefix(struct sr_instance* sr, uint32_t dest, uint32_t mask)
+{
+  struct sr_rt* rt_walker = sr->rt_hash[sr_rt_hash(dest, mask)];
+  while(rt_walker){
+    if((rt_walker->dest.s_addr & rt_walker->mask.s_addr) == (dest & mask) &&
+       rt_walker->mask.s_addr == mask){
+      return rt_walker;
+    }
+    rt_walker = rt_walker->hash_next;
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_alloc() 
+ * @brief function takes a routing entry from the free list, carving a new
+ * slab when it is empty. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @return: an unlinked routing entry
+ *---------------------------------------------------------------------*/
+static struct sr_rt* sr_rt_alloc(struct sr_instance* sr)
+{
+  struct sr_rt* entry;
+  if(sr->rt_free == NULL){
+    struct sr_rt_slab* slab = (struct sr_rt_slab*)malloc(sizeof(struct sr_rt_slab));
+    int i;
+    assert(slab);
+    for(i = SR_RT_SLAB_ENTRIES - 1; i >= 0; i--){
+      slab->entries[i].next = sr->rt_free;
+      sr->rt_free = &(slab->entries[i]);
+    }
+    slab->next = sr->rt_slabs;
+    sr->rt_slabs = slab;
+    sr->rt_slab_count++;
+  }
+  entry = sr->rt_free;
+  sr->rt_free = entry->next;
+  memset(entry, 0, sizeof(struct sr_rt));
+  return entry;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_free() 
+ * @brief function returns an unlinked routing entry to the free list.
+ * Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ *---------------------------------------------------------------------*/
+static void sr_rt_free(struct sr_instance* sr, struct sr_rt* entry)
+{
+  entry->next = sr->rt_free;
+  sr->rt_free = entry;
+}
+
 /*---------------------------------------------------------------------
  * Method: sr_add_rt_entry() 
  * @brief function adds a specified routing table entry   
@@ -129,39 +312,13 @@ void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
     struct in_addr gw, struct in_addr mask, uint32_t metric, char* if_name)
 {   
   struct sr_rt* rt_walker = 0;
+  unsigned int bucket;
 
   assert(if_name);
   assert(sr);
 
-  pthread_mutex_lock(&(sr->rt_locker));
-  /* 1. If the routing table is empty, directly add the entry */
-  if(sr->routing_table == 0)
-  {
-    sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(sr->routing_table);
-    sr->routing_table->next = 0;
-    sr->routing_table->dest = dest;
-    sr->routing_table->gw   = gw;
-    sr->routing_table->mask = mask;
-    strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
-    sr->routing_table->metric = metric;
-    time_t now;
-    time(&now);
-    sr->routing_table->updated_time = now;
-
-    pthread_mutex_unlock(&(sr->rt_locker));
-    return;
-  }
-
-  /* 2. If there already exist some entries in the routing table, find the end of the table first  -- */
-  rt_walker = sr->routing_table;
-  while(rt_walker->next){
-    rt_walker = rt_walker->next; 
-  }
-
-  rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-  assert(rt_walker->next);
-  rt_walker = rt_walker->next;
+  sr_rt_lock(sr);
+  rt_walker = sr_rt_alloc(sr);
   rt_walker->next = 0;
   rt_walker->dest = dest;
   rt_walker->gw   = gw;
@@ -172,369 +329,2123 @@ void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
   time(&now);
   rt_walker->updated_time = now;
 
-  pthread_mutex_unlock(&(sr->rt_locker));
+  /* 1. If the routing table is empty, the entry starts it, otherwise it
+     goes after the current tail */
+  if(sr->routing_table == 0){
+    sr->routing_table = rt_walker;
+  }
+  else{
+    sr->rt_tail->next = rt_walker;
+  }
+  sr->rt_tail = rt_walker;
+  sr->rt_count++;
+
+  /* 2. Index the entry by its prefix */
+  bucket = sr_rt_hash(dest.s_addr, mask.s_addr);
+  rt_walker->hash_next = sr->rt_hash[bucket];
+  sr->rt_hash[bucket] = rt_walker;
+  sr_rt_mark_changed(sr, rt_walker);
+
+  sr_rt_unlock(sr);
 } 
 
 /*---------------------------------------------------------------------
- * Method: sr_print_routing_table() 
- * @brief function print all entries in the routing table.
+ * Method: sr_rt_mark_changed() 
+ * @brief function records that an advertised field (destination, mask,
+ * gateway, interface or metric) of a routing entry changed, so the next
+ * triggered update carries it. Changes to a suppressed route cannot be
+ * seen until it is reused, so they are not recorded. Called with rt_locker
+ * held.
  * @param sr: pointer to simple router state.
+ * @param entry: the routing entry that changed
  *---------------------------------------------------------------------*/
-void sr_print_routing_table(struct sr_instance* sr)
+void sr_rt_mark_changed(struct sr_instance* sr, struct sr_rt* entry)
 {
-  pthread_mutex_lock(&(sr->rt_locker));
-  struct sr_rt* rt_walker = 0;
-
-  if(sr->routing_table == 0)
-  {
-    printf(" *warning* Routing table empty \n");
-    pthread_mutex_unlock(&(sr->rt_locker));
+  if(entry->damp.suppressed){
     return;
   }
-  printf("  <---------- Router Table ---------->\n");
-  printf("Destination\tGateway\t\tMask\t\tIface\tMetric\tUpdate_Time\n");
+  sr->rt_seq++;
+  entry->change_seq = sr->rt_seq;
+  entry->changed_time = time(NULL);
+}
 
-  rt_walker = sr->routing_table;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_find_alt() 
+ * @brief function finds an equal-cost path of a route
+ * @param entry: the routing entry
+ * @param gw: next hop of the path
+ * @param if_name: interface of the path
+ * @return: index in entry->alt, -1 if the route has no such path
+ *---------------------------------------------------------------------*/
+static int sr_rt_find_alt(struct sr_rt* entry, uint32_t gw, const char* if_name)
+{
+  unsigned int i;
+  for(i = 0; i < entry->num_alt; i++){
+    if(entry->alt[i].gw.s_addr == gw && strcmp(entry->alt[i].interface, if_name) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
 
-  while(rt_walker){
-    if (rt_walker->metric < INFINITY)
-      sr_print_routing_entry(rt_walker);
-    rt_walker = rt_walker->next;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_find_link() 
+ * @brief function finds the path of a route learned from a neighbor, if
+ * the route has one
+ * @param entry: the routing entry
+ * @param nbr: the neighbor
+ * @return: the link of that path, NULL if there is none
+ *---------------------------------------------------------------------*/
+static struct sr_rt_link* sr_rt_find_link(struct sr_rt* entry, struct sr_rip_nbr* nbr)
+{
+  unsigned int i;
+  if(entry->link.nbr == nbr){
+    return &(entry->link);
   }
-  pthread_mutex_unlock(&(sr->rt_locker));
+  for(i = 0; i < entry->num_alt; i++){
+    if(entry->alt[i].link.nbr == nbr){
+      return &(entry->alt[i].link);
+    }
+  }
+  if(entry->has_backup && entry->backup.link.nbr == nbr){
+    return &(entry->backup.link);
+  }
+  return NULL;
+}
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_link_of() 
+ * @brief function finds the path of a route learned from a neighbor,
+ * which the route must have
+ * @param entry: the routing entry
+ * @param nbr: the neighbor
+ * @return: the link of that path
+ *---------------------------------------------------------------------*/
+static struct sr_rt_link* sr_rt_link_of(struct sr_rt* entry, struct sr_rip_nbr* nbr)
+{
+  struct sr_rt_link* link = sr_rt_find_link(entry, nbr);
+  assert(link);
+  return link;
+}
 
-} 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_link_attach() 
+ * @brief function records that a path of a route goes through a neighbor.
+ * Called with rt_locker held.
+ * @param nbr: the neighbor
+ * @param entry: the routing entry
+ * @param link: link of the path, currently detached
+ *---------------------------------------------------------------------*/
+static void sr_rt_link_attach(struct sr_rip_nbr* nbr, struct sr_rt* entry, struct sr_rt_link* link)
+{
+  if(nbr->num_routes == nbr->max_routes){
+    nbr->max_routes = nbr->max_routes ? 2 * nbr->max_routes : 16;
+    nbr->routes = (struct sr_rt**)realloc(nbr->routes, nbr->max_routes * sizeof(struct sr_rt*));
+    assert(nbr->routes);
+  }
+  link->nbr = nbr;
+  link->index = nbr->num_routes;
+  nbr->routes[nbr->num_routes++] = entry;
+}
 
 /*---------------------------------------------------------------------
- * Method: sr_print_routing_entry() 
- * @brief function print the specified entries in the routing table.
- * @param entry: pointer to the routing entry.
+ * Method: sr_rt_link_detach() 
+ * @brief function removes a path from its neighbor's routes in O(1), by
+ * moving the neighbor's last route into its slot. Called with rt_locker
+ * held.
+ * @param link: link of the path
  *---------------------------------------------------------------------*/
-void sr_print_routing_entry(struct sr_rt* entry)
+static void sr_rt_link_detach(struct sr_rt_link* link)
 {
-  assert(entry);
-  assert(entry->interface);
+  struct sr_rip_nbr* nbr = link->nbr;
+  struct sr_rt* moved;
 
-  char buff[20];
-  struct tm* timenow = localtime(&(entry->updated_time));
-  strftime(buff, sizeof(buff), "%H:%M:%S", timenow);
-  printf("%s\t",inet_ntoa(entry->dest));
-  printf("%s\t",inet_ntoa(entry->gw));
-  printf("%s\t",inet_ntoa(entry->mask));
-  printf("%s\t",entry->interface);
-  printf("%d\t",entry->metric);
-  printf("%s\n", buff);
+  if(nbr == NULL){
+    return;
+  }
+  moved = nbr->routes[--nbr->num_routes];
+  if(link->index != nbr->num_routes){
+    nbr->routes[link->index] = moved;
+    sr_rt_link_of(moved, nbr)->index = link->index;
+  }
+  link->nbr = NULL;
+}
 
-} 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_remove_alt() 
+ * @brief function removes an equal-cost path from the array, links and all
+ * @param entry: the routing entry
+ * @param i: index in entry->alt
+ *---------------------------------------------------------------------*/
+static void sr_rt_remove_alt(struct sr_rt* entry, unsigned int i)
+{
+  entry->num_alt--;
+  memmove(&(entry->alt[i]), &(entry->alt[i + 1]), (entry->num_alt - i) * sizeof(struct sr_rt_path));
+}
 
 /*---------------------------------------------------------------------
- * Method: sr_rip_timeout() 
- * @brief function periodically checks the status of all interfaces and updates the routing table   
- * @param sr_ptr: pointer to simple router state.
+ * Method: sr_rt_clear_alts() 
+ * @brief function forgets all equal-cost paths of a route. Called with
+ * rt_locker held.
+ * @param entry: the routing entry
  *---------------------------------------------------------------------*/
-void *sr_rip_timeout(void *sr_ptr) {
-  struct sr_instance *sr = sr_ptr;
-  while (1) {
-    /* 1 update the routing table and send RIP response message to neighbors every 5 seconds */
-    sleep(5);
-    pthread_mutex_lock(&(sr->rt_locker));
-
-    struct sr_rt * pointer1 = sr->routing_table;
-    /* 2 For each entry in your routing table*/
-    while (pointer1 != NULL) {
-      /* 2.a check whether this entry has expired (Current_time – Updated_time >= 20 seconds).*/
-      if(difftime(time(NULL), pointer1->updated_time) > 20){
-        /* 2.b If expired, delete it from the routing table*/
-        pointer1->metric = INFINITY;
-      }
-      pointer1=pointer1->next;
-    }
-
-    struct sr_if* interface = sr->if_list;
-    /* 3 Checking the status of the router's own interfaces*/
-    while(interface!=NULL){
-      /* 3.a If the status of an interface is down*/
-      /*you should delete all the routing entries which use this interface to send packets*/
-      if(sr_obtain_interface_status(sr,interface->name)==0){
-        struct sr_rt * pointer2 = sr->routing_table;
-        while (pointer2 != NULL) {
-          if(strcmp(pointer2->interface, interface->name)==0){
-            pointer2->metric = INFINITY;
-          }
-          pointer2=pointer2->next;
-        }
-      }
-      /* 3.b If the status of an interface is up*/
-      /* you should check whether your current routing table contains the subnet this interface is directly connected to.*/
-      else{
-        struct sr_rt * pointer3 = sr->routing_table;
-        bool found = false;
-        while (pointer3 != NULL) {
-          /* 3.b.1 If it contains, update the updated time, metric, gateway, and interface in the routing entry*/
-          if((pointer3->dest.s_addr & pointer3->mask.s_addr) == (interface->ip & interface->mask) && pointer3->mask.s_addr == interface->mask){
-            /* Lab4-Task3 TODO */
-            pointer3->updated_time = time(NULL); /*update time */
-            pointer3->metric = 0;
-            pointer3->gw.s_addr = 0;
-            strcpy(pointer3->interface, interface->name);
-            /* End TODO */
-            found = true;
-          }
-          pointer3 = pointer3->next;
-        }
-        /* 3.b.2 Otherwise, add this subnet to your routing table*/
-        if(!found){
-          struct in_addr address;
-          address.s_addr = interface->ip;
-          struct in_addr gw;
-          gw.s_addr = 0x0;
-          struct in_addr mask;
-          mask.s_addr = interface->mask;
-          sr_add_rt_entry(sr,address,gw,mask,0,interface->name);
-        }
-      }
-      interface = interface->next;
-    }
-    /* 4 Send RIP response in timeout */
-    send_rip_response(sr);     
-    sr_print_routing_table(sr);   
-    pthread_mutex_unlock(&(sr->rt_locker));
+static void sr_rt_clear_alts(struct sr_rt* entry)
+{
+  while(entry->num_alt > 0){
+    sr_rt_link_detach(&(entry->alt[entry->num_alt - 1].link));
+    entry->num_alt--;
   }
-  return NULL;
 }
 
 /*---------------------------------------------------------------------
- * Method: send_rip_request() 
- * @brief function send RIP request to all its neighbors    
+ * Method: sr_rt_drop_alt() 
+ * @brief function removes an equal-cost path of a route. Called with
+ * rt_locker held.
  * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ * @param i: index in entry->alt
  *---------------------------------------------------------------------*/
-void send_rip_request(struct sr_instance *sr){
-  pthread_mutex_lock(&(sr->rt_locker));
-
-  struct sr_if* interface = sr->if_list;
-  /*1 Send RIP request to every interface(i.e., neighbor)*/
-  while(interface!=NULL){
+static void sr_rt_drop_alt(struct sr_instance* sr, struct sr_rt* entry, unsigned int i)
+{
+  sr_rt_link_detach(&(entry->alt[i].link));
+  sr_rt_remove_alt(entry, i);
+  sr_rt_mark_changed(sr, entry);
+}
 
-    unsigned int packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t);
-    uint8_t * block = (uint8_t *) malloc(packet_len);
-    memset(block, 0, sizeof(uint8_t) * packet_len);
-
-    /* 1.a Set Ethernet header */
-    sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)block;
-    /* Lab4-Task3 TODO: set source and destination MAC addresses */ 
-    memcpy(ethernet_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
-    memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
-    /* End TODO */ 
-    ethernet_hdr->ether_type = htons(ethertype_ip);
-
-
-    /* 1.b Set IP header */  
-    sr_ip_hdr_t* pkt = (sr_ip_hdr_t *)(block + sizeof(sr_ethernet_hdr_t));
-    pkt->ip_hl = 0x5;
-    pkt->ip_v  = 0x4;
-    pkt->ip_tos = iptos;
-    pkt->ip_len = htons((uint16_t) (sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t)));
-    pkt->ip_id = htons(ipid);
-    pkt->ip_off = htons(ipoff);
-    pkt->ip_ttl = ipttl;
-    
-    /* Lab4-Task3 TODO: set protocol in the IP header */ 
-    pkt->ip_p = ip_protocol_udp;
-    /* End TODO */ 
-    
-    pkt->ip_sum = 0;
-    pkt->ip_src = interface->ip;
-    
-    /* Lab4-Task3 TODO: set destination ip address in the IP header */ 
-    pkt->ip_dst = htonl(broadcast_ip);
-    /* End TODO */ 
-    
-    pkt->ip_sum = cksum(((void *) pkt), sizeof(sr_ip_hdr_t));
-
-
-    /*1.c Set UDP header*/
-    sr_udp_hdr_t* udp_hdr = (sr_udp_hdr_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
-    udp_hdr->port_dst = 520;
-    udp_hdr->port_src = 520;
-    udp_hdr->udp_len = htons((uint16_t)sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t));
-    udp_hdr->udp_sum = 0;
-    udp_hdr->udp_sum = cksum(((void *) udp_hdr), sizeof(sr_udp_hdr_t));
-
-    /*1.d Set RIP header*/
-    sr_rip_pkt_t* rip_hdr = (sr_rip_pkt_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
-    rip_hdr->command = 1;
-    rip_hdr->version = 2;
-    rip_hdr->unused = 0;
-    rip_hdr->entries[0].metric = INFINITY;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_promote_alt() 
+ * @brief function replaces the next hop of a route that lost it by its
+ * first equal-cost path, keeping the route's metric. Called with rt_locker
+ * held.
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry, with at least one equal-cost path
+ * @param metric: the metric the paths share
+ *---------------------------------------------------------------------*/
+static void sr_rt_promote_alt(struct sr_instance* sr, struct sr_rt* entry, uint32_t metric)
+{
+  sr_rt_link_detach(&(entry->link));
+  entry->gw = entry->alt[0].gw;
+  memcpy(entry->interface, entry->alt[0].interface, sr_IFACE_NAMELEN);
+  entry->updated_time = entry->alt[0].updated_time;
+  entry->link = entry->alt[0].link; /* same route, so its index holds */
+  entry->metric = metric;
+  sr_rt_remove_alt(entry, 0);
+  sr_rt_mark_changed(sr, entry);
+}
 
-    /*1.e Send the request*/
-    sr_send_packet(sr, block, packet_len, interface->name );
-    free(block);
-    interface = interface->next;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_drop_backup() 
+ * @brief function forgets the backup path of a route. Backup paths are
+ * not advertised, so their changes bump rt_backup_gen rather than rt_seq;
+ * this and sr_rt_offer_backup() are the only places that record them. A
+ * failover to the backup changes the route itself, and is marked changed.
+ * Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ *---------------------------------------------------------------------*/
+static void sr_rt_drop_backup(struct sr_instance* sr, struct sr_rt* entry)
+{
+  if(entry->has_backup){
+    sr_rt_link_detach(&(entry->backup.link));
+    entry->has_backup = 0;
+    sr->rt_backup_gen++;
   }
-  pthread_mutex_unlock(&(sr->rt_locker));
 }
 
 /*---------------------------------------------------------------------
- * Method: send_rip_request() 
- * @brief function send RIP request to all its neighbors    
+ * Method: sr_rt_offer_backup() 
+ * @brief function keeps a path longer than the route's as its backup, if
+ * it is the backup already or shorter than it. Called with rt_locker held.
  * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ * @param nbr: neighbor the path was learned from
+ * @param gw: next hop of the path
+ * @param if_name: interface of the path
+ * @param metric: metric of the path, below INFINITY
  *---------------------------------------------------------------------*/
-void send_rip_response(struct sr_instance *sr){
-  pthread_mutex_lock(&(sr->rt_locker));
-
-  struct sr_if* interface = sr->if_list;
-  /* 1 Send response to every interface (i.e., neighbor)*/
-  while(interface!=NULL){
-    unsigned int packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t);
-    uint8_t * block = (uint8_t *) malloc(packet_len);
-    memset(block, 0, sizeof(uint8_t) * packet_len);
-
-    /*1.a Set Ethernet header*/
-    /* Lab4-Task3 TODO */
-    /* Hint: You can refer to the header setting in send_rip_request() function  */
-    sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)block;
-    memcpy(ethernet_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
-    memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
-    ethernet_hdr->ether_type = htons(ethertype_ip);
-    /* End TODO */
+static void sr_rt_offer_backup(struct sr_instance* sr, struct sr_rt* entry, struct sr_rip_nbr* nbr,
+                               uint32_t gw, const char* if_name, uint32_t metric)
+{
+  struct sr_rt_path* path = &(entry->backup);
+  if(entry->has_backup && path->gw.s_addr == gw && strcmp(path->interface, if_name) == 0){
+    if(entry->backup_metric != metric){
+      entry->backup_metric = metric;
+      sr->rt_backup_gen++;
+    }
+    path->updated_time = time(0);
+    return;
+  }
+  if(entry->has_backup && entry->backup_metric <= metric){
+    return;
+  }
+  sr_rt_drop_backup(sr, entry);
+  path->gw.s_addr = gw;
+  strncpy(path->interface, if_name, sr_IFACE_NAMELEN - 1);
+  path->interface[sr_IFACE_NAMELEN - 1] = '\0';
+  path->updated_time = time(0);
+  entry->backup_metric = metric;
+  entry->has_backup = 1;
+  sr_rt_link_attach(nbr, entry, &(path->link));
+  sr->rt_backup_gen++;
+}
 
-    /*1.b Set IP header*/  
-    /* Lab4-Task3 TODO */ 
-    sr_ip_hdr_t* pkt = (sr_ip_hdr_t *)(block + sizeof(sr_ethernet_hdr_t));
-    pkt->ip_hl = 0x5;
-    pkt->ip_v  = 0x4;
-    pkt->ip_tos = iptos;
-    pkt->ip_len = htons((uint16_t) (sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t)));
-    pkt->ip_id = htons(ipid);
-    pkt->ip_off = htons(ipoff);
-    pkt->ip_ttl = ipttl;
-    pkt->ip_p = ip_protocol_udp;
-    pkt->ip_sum = 0;
-    pkt->ip_src = interface->ip;
-    pkt->ip_dst = htonl(broadcast_ip);
-    pkt->ip_sum = cksum(((void *) pkt), sizeof(sr_ip_hdr_t));
-    /* End TODO */
+/*---------------------------------------------------------------------
+ * Method: sr_rt_damp_decay() 
+ * @brief function decays the flap penalty of a route to now
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ * @param now: sr_now_ms()
+ *---------------------------------------------------------------------*/
+static void sr_rt_damp_decay(struct sr_instance* sr, struct sr_rt* entry, uint64_t now)
+{
+  struct sr_rt_damp* damp = &(entry->damp);
+  if(sr->rip_damp_half_life_ms == 0){
+    damp->penalty = 0;
+  }
+  else if(damp->penalty > 0 && now > damp->updated_ms){
+    damp->penalty = sr_decay(damp->penalty, now - damp->updated_ms, sr->rip_damp_half_life_ms);
+  }
+  damp->updated_ms = now;
+}
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_damp_flap() 
+ * @brief function charges a RIP-learned route for being withdrawn, and
+ * suppresses it once its penalty crosses the suppress threshold. Called
+ * with rt_locker held, after the withdrawal is recorded.
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry
+ *---------------------------------------------------------------------*/
+static void sr_rt_damp_flap(struct sr_instance* sr, struct sr_rt* entry)
+{
+  struct sr_rt_damp* damp = &(entry->damp);
+  if(sr->rip_damp_half_life_ms == 0){
+    return;
+  }
+  sr_rt_damp_decay(sr, entry, sr_now_ms());
+  damp->penalty += SR_RIP_DAMP_PENALTY;
+  if(damp->penalty > SR_RIP_DAMP_MAX){
+    damp->penalty = SR_RIP_DAMP_MAX;
+  }
+  damp->flaps++;
+  sr->rt_damp_flaps++;
+  if(!damp->suppressed && damp->penalty >= sr->rip_damp_suppress){
+    damp->suppressed = 1;
+    sr->rt_damp_suppressions++;
+  }
+}
 
-    /*1.c Set UDP header*/
-    /* Lab4-Task3 TODO */ 
-    sr_udp_hdr_t* udp_hdr = (sr_udp_hdr_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
-    udp_hdr->port_dst = 520;
-    udp_hdr->port_src = 520;
-    udp_hdr->udp_len = htons((uint16_t)sizeof(sr_udp_hdr_t)+sizeof(sr_rip_pkt_t));
-    udp_hdr->udp_sum = 0;
-    udp_hdr->udp_sum = cksum(((void *) udp_hdr), sizeof(sr_udp_hdr_t));
-    /* End TODO */
+/*---------------------------------------------------------------------
+ * Method: sr_rt_damp_clear() 
+ * @brief function forgets the flap history of a route that is no longer
+ * RIP-learned, so it is advertised and forwarded on again. Call it before
+ * sr_rt_mark_changed(), which skips suppressed routes.
+ * @param entry: the routing entry
+ *---------------------------------------------------------------------*/
+static void sr_rt_damp_clear(struct sr_rt* entry)
+{
+  entry->damp.penalty = 0;
+  entry->damp.suppressed = 0;
+}
 
-    /*1.d Set RIP header*/
-    /* Lab4-Task3 TODO */ 
-    sr_rip_pkt_t* rip_hdr = (sr_rip_pkt_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
-    rip_hdr->command = 2;
-    rip_hdr->version = 2;
-    rip_hdr->unused = 0;
-    /* End TODO */
-    
-    struct sr_rt * table = sr->routing_table; 
-    int i = 0;
-    memset(&rip_hdr->entries,0,MAX_NUM_ENTRIES*sizeof(struct entry));
-    while(table!=NULL){
-      if(strcmp(table->interface, interface->name)!=0){
-        rip_hdr->entries[i].afi = htons(2);
-        /* Lab4-Task3 TODO */
-        /*You need to assign values to the fields in the RIP header, e.g., address, mask, next_hop and metric*/
-        rip_hdr->entries[i].address = table->dest.s_addr;
-        rip_hdr->entries[i].mask = table->mask.s_addr;
-        rip_hdr->entries[i].next_hop = table->gw.s_addr;
-        rip_hdr->entries[i].metric = table->metric;
-        /* End TODO */
-        i = i+1;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_damp_reuse() 
+ * @brief function reuses the suppressed routes whose penalty decayed
+ * below the reuse threshold, advertising them again. Called with
+ * rt_locker held.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+static void sr_rt_damp_reuse(struct sr_instance* sr)
+{
+  uint64_t now = sr_now_ms();
+  struct sr_rt* entry;
+  for(entry = sr->routing_table; entry; entry = entry->next){
+    if(entry->damp.suppressed){
+      sr_rt_damp_decay(sr, entry, now);
+      if(entry->damp.penalty < sr->rip_damp_reuse || sr->rip_damp_half_life_ms == 0){
+        entry->damp.suppressed = 0;
+        sr_rt_mark_changed(sr, entry);
       }
-      table=table->next;
     }
+  }
+}
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_withdraw() 
+ * @brief function handles the loss of the next hop of a route: it fails
+ * over to an equal-cost path, else to the backup path, and only then
+ * becomes unreachable, which counts as a flap of a RIP-learned route.
+ * The neighbor link of a lost path that becomes
+ * unreachable is left to the caller. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param entry: the routing entry, still reachable
+ *---------------------------------------------------------------------*/
+static void sr_rt_withdraw(struct sr_instance* sr, struct sr_rt* entry)
+{
+  if(entry->num_alt > 0){
+    sr_rt_promote_alt(sr, entry, entry->metric);
+  }
+  else if(entry->has_backup){
+    sr_rt_link_detach(&(entry->link));
+    entry->gw = entry->backup.gw;
+    memcpy(entry->interface, entry->backup.interface, sr_IFACE_NAMELEN);
+    entry->updated_time = entry->backup.updated_time;
+    entry->link = entry->backup.link; /* same route, so its index holds */
+    entry->metric = entry->backup_metric;
+    entry->has_backup = 0;
+    sr->rt_failovers++;
+    sr_rt_mark_changed(sr, entry);
+  }
+  else{
+    entry->metric = INFINITY;
+    sr_rt_mark_changed(sr, entry);
+    if(entry->link.nbr != NULL){
+      sr_rt_damp_flap(sr, entry);
+    }
+  }
+}
 
-    /*2 Send RIP response*/
-    sr_send_packet(sr, block, packet_len, interface->name );
-    free(block);
-    interface = interface->next;
-
+/*---------------------------------------------------------------------
+ * Method: sr_rt_uses_interface() 
+ * @brief function tells whether any path of a route goes out of if_name
+ * @param entry: the routing entry
+ * @param if_name: the interface
+ *---------------------------------------------------------------------*/
+static bool sr_rt_uses_interface(struct sr_rt* entry, const char* if_name)
+{
+  unsigned int i;
+  if(strcmp(entry->interface, if_name) == 0){
+    return true;
   }
+  for(i = 0; i < entry->num_alt; i++){
+    if(strcmp(entry->alt[i].interface, if_name) == 0){
+      return true;
+    }
+  }
+  return false;
+}
 
-  pthread_mutex_unlock(&(sr->rt_locker));
+/*---------------------------------------------------------------------
+ * Method: sr_rt_select_path() 
+ * @brief function picks one of the equal-cost next hops of a route for a
+ * flow, so all packets of the flow take the same path
+ * @param entry: the routing entry
+ * @param hash: hash of the flow
+ * @param gw: set to the next hop of the path, 0 for direct delivery
+ * @param if_name: set to the interface of the path
+ * @return: index of the path, 0 being entry->gw
+ *---------------------------------------------------------------------*/
+unsigned int sr_rt_select_path(struct sr_rt* entry, uint32_t hash,
+                               struct in_addr* gw, char** if_name)
+{
+  unsigned int path = hash % (entry->num_alt + 1);
+  if(path == 0){
+    *gw = entry->gw;
+    *if_name = entry->interface;
+  }
+  else{
+    *gw = entry->alt[path - 1].gw;
+    *if_name = entry->alt[path - 1].interface;
+  }
+  return path;
 }
 
 /*---------------------------------------------------------------------
- * Method: update_route_table() 
- * @brief function update the routing table based on the received routing entries from neighbors    
+ * Method: sr_rt_flush() 
+ * @brief function garbage collects routes that have been unreachable for
+ * longer than the flush interval, so they have been advertised as such
+ * and can be forgotten. Called with rt_locker held.
  * @param sr: pointer to simple router state.
- * @param packet: received RIP response packet.
+ *---------------------------------------------------------------------*/
+static void sr_rt_flush(struct sr_instance* sr)
+{
+  struct sr_rt* prev = NULL;
+  struct sr_rt* rt_walker = sr->routing_table;
+  time_t now = time(NULL);
+
+  if(sr->rip_flush_secs == 0){
+    return;
+  }
+  while(rt_walker){
+    struct sr_rt* rt_next = rt_walker->next;
+    if(rt_walker->metric == INFINITY && !rt_walker->damp.suppressed &&
+       difftime(now, rt_walker->changed_time) >= sr->rip_flush_secs){
+      /* unlink it from the list */
+      if(prev){
+        prev->next = rt_next;
+      }
+      else{
+        sr->routing_table = rt_next;
+      }
+      if(sr->rt_tail == rt_walker){
+        sr->rt_tail = prev;
+      }
+      /* and from its hash chain */
+      struct sr_rt** link = &(sr->rt_hash[sr_rt_hash(rt_walker->dest.s_addr, rt_walker->mask.s_addr)]);
+      while(*link != rt_walker){
+        link = &((*link)->hash_next);
+      }
+      *link = rt_walker->hash_next;
+      /* and from its neighbors */
+      sr_rt_clear_alts(rt_walker);
+      sr_rt_drop_backup(sr, rt_walker);
+      sr_rt_link_detach(&(rt_walker->link));
+      sr_rt_free(sr, rt_walker);
+      sr->rt_count--;
+      sr->rt_flushed++;
+      /* the advertised table lost a route, stale its templates */
+      sr->rt_seq++;
+    }
+    else{
+      prev = rt_walker;
+    }
+    rt_walker = rt_next;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_print_routing_table() 
+ * @brief function print all entries in the routing table.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_print_routing_table(struct sr_instance* sr)
+{
+  struct sr_rt_snapshot snap;
+  unsigned int i;
+
+  sr_rt_take_snapshot(sr, 0, &snap);
+  if(snap.len == 0)
+  {
+    printf(" *warning* Routing table empty \n");
+    sr_rt_free_snapshot(&snap);
+    return;
+  }
+  printf("  <---------- Router Table ---------->\n");
+  printf("Destination\tGateway\t\tMask\t\tIface\tMetric\tUpdate_Time\n");
+
+  uint64_t now = sr_now_ms();
+  for(i = 0; i < snap.len; i++){
+    /* the copies show the penalty as of now */
+    sr_rt_damp_decay(sr, &(snap.entries[i]), now);
+    if (snap.entries[i].metric < INFINITY || snap.entries[i].damp.suppressed)
+      sr_print_routing_entry(&(snap.entries[i]));
+  }
+  sr_rt_free_snapshot(&snap);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_print_routing_entry() 
+ * @brief function print the specified entries in the routing table.
+ * @param entry: pointer to the routing entry.
+ *---------------------------------------------------------------------*/
+void sr_print_routing_entry(struct sr_rt* entry)
+{
+  assert(entry);
+  assert(entry->interface);
+
+  char buff[20];
+  struct tm* timenow = localtime(&(entry->updated_time));
+  strftime(buff, sizeof(buff), "%H:%M:%S", timenow);
+  printf("%s\t",inet_ntoa(entry->dest));
+  printf("%s\t",inet_ntoa(entry->gw));
+  printf("%s\t",inet_ntoa(entry->mask));
+  printf("%s\t",entry->interface);
+  printf("%d\t",entry->metric);
+  printf("%s\n", buff);
+  unsigned int i;
+  for(i = 0; i < entry->num_alt; i++){
+    printf("  (ecmp)\t%s\t\t\t%s\n", inet_ntoa(entry->alt[i].gw), entry->alt[i].interface);
+  }
+  if(entry->damp.penalty > 0 || entry->damp.suppressed){
+    printf("  (damped)\tpenalty %u, %lu flaps%s\n", entry->damp.penalty, entry->damp.flaps,
+           entry->damp.suppressed ? ", suppressed" : "");
+  }
+  if(entry->has_backup){
+    printf("  (backup)\t%s\t\t\t%s\t%d\n", inet_ntoa(entry->backup.gw),
+           entry->backup.interface, entry->backup_metric);
+  }
+
+} 
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_sync() 
+ * @brief function makes the routing table hold exactly the given routes,
+ * as computed by a link-state engine: each is added, or updated in place
+ * if its next hop or metric changed, and every other route is withdrawn
+ * and later garbage collected.
+ * @param sr: pointer to simple router state.
+ * @param routes: the routes, only dest, gw, mask, interface and metric are
+ * read
+ * @param n: number of routes
+ *---------------------------------------------------------------------*/
+void sr_rt_sync(struct sr_instance *sr, struct sr_rt *routes, unsigned int n) {
+  struct sr_rt* entry;
+  unsigned int i;
+
+  sr_rt_lock(sr);
+  sr->rt_sync_gen++;
+  for(i = 0; i < n; i++){
+    struct sr_rt* route = &(routes[i]);
+    entry = sr_rt_lookup_prefix(sr, route->dest.s_addr, route->mask.s_addr);
+    if(entry == NULL){
+      sr_add_rt_entry(sr, route->dest, route->gw, route->mask, route->metric, route->interface);
+      entry = sr_rt_lookup_prefix(sr, route->dest.s_addr, route->mask.s_addr);
+    }
+    else if(entry->gw.s_addr != route->gw.s_addr || entry->metric != route->metric ||
+            strcmp(entry->interface, route->interface) != 0 || entry->damp.suppressed){
+      entry->gw = route->gw;
+      entry->metric = route->metric;
+      memcpy(entry->interface, route->interface, sr_IFACE_NAMELEN);
+      sr_rt_clear_alts(entry);
+      sr_rt_drop_backup(sr, entry);
+      sr_rt_link_detach(&(entry->link));
+      sr_rt_damp_clear(entry);
+      sr_rt_mark_changed(sr, entry);
+    }
+    entry->updated_time = time(NULL);
+    entry->sync_gen = sr->rt_sync_gen;
+  }
+  for(entry = sr->routing_table; entry; entry = entry->next){
+    if(entry->sync_gen != sr->rt_sync_gen && entry->metric != INFINITY){
+      entry->metric = INFINITY;
+      sr_rt_mark_changed(sr, entry);
+    }
+  }
+  sr_rt_flush(sr);
+  sr_rt_unlock(sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_add_aggregates() 
+ * @brief function configures aggregate ranges, given as a comma
+ * separated list of interface:prefix/length
+ * @param sr: pointer to simple router state.
+ * @param spec: the list, e.g. "eth1:10.0.0.0/16,eth2:172.16.0.0/12"
+ * @return: 0 success
+ *          -1 if an item does not parse
+ *---------------------------------------------------------------------*/
+int sr_rip_add_aggregates(struct sr_instance *sr, const char *spec) {
+  char* copy = strdup(spec);
+  char* save = NULL;
+  char* item;
+  int ret = 0;
+
+  assert(copy);
+  for(item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)){
+    char* colon = strchr(item, ':');
+    char* slash = strchr(item, '/');
+    struct in_addr dest;
+    int len;
+    if(colon == NULL || slash == NULL || slash < colon || colon - item >= sr_IFACE_NAMELEN){
+      ret = -1;
+      break;
+    }
+    *colon = '\0';
+    *slash = '\0';
+    len = atoi(slash + 1);
+    if(inet_aton(colon + 1, &dest) == 0 || len < 0 || len > 32){
+      ret = -1;
+      break;
+    }
+    struct sr_rip_aggregate* agg = (struct sr_rip_aggregate*)calloc(1, sizeof(struct sr_rip_aggregate));
+    assert(agg);
+    strncpy(agg->interface, item, sr_IFACE_NAMELEN - 1);
+    agg->mask = len ? htonl(0xffffffffu << (32 - len)) : 0;
+    agg->dest = dest.s_addr & agg->mask;
+    agg->next = sr->rip_aggregates;
+    sr->rip_aggregates = agg;
+  }
+  free(copy);
+  return ret;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_import_of() 
+ * @brief function finds the import policy of an interface
+ * @param sr: pointer to simple router state.
+ * @param if_name: the interface
+ * @param create: add an empty policy if it has none
+ * @return: the policy, NULL if it has none
+ *---------------------------------------------------------------------*/
+static struct sr_rip_import* sr_rip_import_of(struct sr_instance *sr, const char *if_name, bool create) {
+  struct sr_rip_import* imp;
+  for(imp = sr->rip_imports; imp; imp = imp->next){
+    if(strcmp(imp->interface, if_name) == 0){
+      return imp;
+    }
+  }
+  if(!create){
+    return NULL;
+  }
+  imp = (struct sr_rip_import*)calloc(1, sizeof(struct sr_rip_import));
+  assert(imp);
+  strncpy(imp->interface, if_name, sr_IFACE_NAMELEN - 1);
+  imp->trie = (struct sr_rip_filter_node*)calloc(1, sizeof(struct sr_rip_filter_node));
+  assert(imp->trie);
+  imp->next = sr->rip_imports;
+  sr->rip_imports = imp;
+  return imp;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_import_add_rule() 
+ * @brief function compiles a prefix list rule into the trie of a policy,
+ * at the node of its prefix
+ * @param imp: the policy
+ * @param permit: permit or deny
+ * @param dest: the prefix, in network order
+ * @param len: its length
+ * @param ge: shortest matching length
+ * @param le: longest matching length
+ *---------------------------------------------------------------------*/
+static void sr_rip_import_add_rule(struct sr_rip_import *imp, int permit, uint32_t dest,
+    int len, int ge, int le) {
+  struct sr_rip_filter_node* node = imp->trie;
+  struct sr_rip_filter_rule* rule;
+  struct sr_rip_filter_rule** tail;
+  uint32_t bits = ntohl(dest);
+  int depth;
+
+  for(depth = 0; depth < len; depth++){
+    int bit = (bits >> (31 - depth)) & 1;
+    if(node->child[bit] == NULL){
+      node->child[bit] = (struct sr_rip_filter_node*)calloc(1, sizeof(struct sr_rip_filter_node));
+      assert(node->child[bit]);
+    }
+    node = node->child[bit];
+  }
+  rule = (struct sr_rip_filter_rule*)calloc(1, sizeof(struct sr_rip_filter_rule));
+  assert(rule);
+  rule->seq = imp->num_rules++;
+  rule->permit = permit;
+  rule->ge = ge;
+  rule->le = le;
+  for(tail = &(node->rules); *tail; tail = &((*tail)->next));
+  *tail = rule;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_import_permits() 
+ * @brief function matches a route against an import policy. Only the
+ * trie nodes on the route's own prefix bits, down to its length, can hold
+ * a matching rule; of those whose length bounds it fits, the one listed
+ * first decides. A route no rule matches is denied, unless the list is
+ * empty.
+ * @param imp: the policy, NULL for none
+ * @param dest: the route's destination, in network order
+ * @param mask: and mask
+ *---------------------------------------------------------------------*/
+static bool sr_rip_import_permits(struct sr_rip_import *imp, uint32_t dest, uint32_t mask) {
+  struct sr_rip_filter_node* node;
+  struct sr_rip_filter_rule* best = NULL;
+  uint32_t bits = ntohl(dest);
+  uint32_t m = ntohl(mask);
+  int len = 0, depth;
+
+  if(imp == NULL || imp->num_rules == 0){
+    return true;
+  }
+  while(m & 0x80000000u){
+    len++;
+    m <<= 1;
+  }
+  for(node = imp->trie, depth = 0; node; depth++){
+    struct sr_rip_filter_rule* rule;
+    for(rule = node->rules; rule; rule = rule->next){
+      if(len >= rule->ge && len <= rule->le && (best == NULL || rule->seq < best->seq)){
+        best = rule;
+      }
+    }
+    if(depth == len){
+      break;
+    }
+    node = node->child[(bits >> (31 - depth)) & 1];
+  }
+  return best != NULL && best->permit;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_import_parse() 
+ * @brief function parses one line of an import policy file
+ * @param sr: pointer to simple router state.
+ * @param line: the line, tokenized in place
+ * @return: 0 success
+ *          -1 otherwise
+ *---------------------------------------------------------------------*/
+static int sr_rip_import_parse(struct sr_instance *sr, char *line) {
+  const char* delim = " \t\r\n";
+  char* save = NULL;
+  char* iface = strtok_r(line, delim, &save);
+  char* action = strtok_r(NULL, delim, &save);
+  char* arg = strtok_r(NULL, delim, &save);
+  char* opt;
+  char* slash;
+  struct sr_rip_import* imp;
+  struct in_addr dest;
+  int len, ge = -1, le = -1;
+
+  if(iface == NULL || iface[0] == '#'){
+    return 0;
+  }
+  if(action == NULL || arg == NULL || strlen(iface) >= sr_IFACE_NAMELEN){
+    return -1;
+  }
+  imp = sr_rip_import_of(sr, iface, true);
+
+  if(strcmp(action, "max-prefix") == 0){
+    opt = strtok_r(NULL, delim, &save);
+    if(atoi(arg) <= 0){
+      return -1;
+    }
+    if(opt == NULL || strcmp(opt, "warn") == 0){
+      imp->max_prefix_action = rip_max_prefix_warn;
+    }
+    else if(strcmp(opt, "shutdown") == 0){
+      imp->max_prefix_action = rip_max_prefix_shutdown;
+    }
+    else{
+      return -1;
+    }
+    imp->max_prefix = atoi(arg);
+    return 0;
+  }
+  if(strcmp(action, "permit") != 0 && strcmp(action, "deny") != 0){
+    return -1;
+  }
+
+  slash = strchr(arg, '/');
+  if(slash == NULL){
+    return -1;
+  }
+  *slash = '\0';
+  len = atoi(slash + 1);
+  if(inet_aton(arg, &dest) == 0 || len < 0 || len > 32){
+    return -1;
+  }
+  while((opt = strtok_r(NULL, delim, &save)) != NULL){
+    char* value = strtok_r(NULL, delim, &save);
+    if(value == NULL){
+      return -1;
+    }
+    if(strcmp(opt, "ge") == 0){
+      ge = atoi(value);
+    }
+    else if(strcmp(opt, "le") == 0){
+      le = atoi(value);
+    }
+    else{
+      return -1;
+    }
+  }
+  if(ge < 0){
+    ge = len;
+  }
+  if(le < 0){
+    le = ge > len ? 32 : len;
+  }
+  if(ge < len || le < ge || le > 32){
+    return -1;
+  }
+  dest.s_addr &= len ? htonl(0xffffffffu << (32 - len)) : 0;
+  sr_rip_import_add_rule(imp, strcmp(action, "permit") == 0, dest.s_addr, len, ge, le);
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_load_imports() 
+ * @brief function loads the import policies from a file, one rule per
+ * line:
+ *   <iface> permit|deny <prefix>/<len> [ge <n>] [le <n>]
+ *   <iface> max-prefix <n> [warn|shutdown]
+ * Without ge and le a rule matches its own length only; with ge alone up
+ * to 32; with le alone from its own length on. Lines starting with # are
+ * comments.
+ * @param sr: pointer to simple router state.
+ * @param filename: the file
+ * @return: 0 success
+ *          -1 otherwise
+ *---------------------------------------------------------------------*/
+int sr_rip_load_imports(struct sr_instance *sr, const char *filename) {
+  FILE* fp;
+  char line[BUFSIZ];
+  int line_no = 0;
+
+  assert(filename);
+  fp = fopen(filename, "r");
+  if(fp == NULL){
+    perror("fopen");
+    return -1;
+  }
+  while(fgets(line, BUFSIZ, fp) != 0){
+    line_no++;
+    if(sr_rip_import_parse(sr, line) != 0){
+      fprintf(stderr, "Error parsing import policy %s, line %d\n", filename, line_no);
+      fclose(fp);
+      return -1;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_nbr_get() 
+ * @brief function finds a neighbor in the neighbor table, adding it the
+ * first time it is heard from. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param ip: source IP of its responses
+ * @param if_name: interface they are received on
+ * @return: the neighbor
+ *---------------------------------------------------------------------*/
+static struct sr_rip_nbr* sr_rip_nbr_get(struct sr_instance *sr, uint32_t ip, const char *if_name) {
+  struct sr_rip_nbr* nbr;
+  for(nbr = sr->rip_nbrs; nbr; nbr = nbr->next){
+    if(nbr->ip == ip && strcmp(nbr->interface, if_name) == 0){
+      return nbr;
+    }
+  }
+  nbr = (struct sr_rip_nbr*)calloc(1, sizeof(struct sr_rip_nbr));
+  assert(nbr);
+  nbr->ip = ip;
+  strncpy(nbr->interface, if_name, sr_IFACE_NAMELEN - 1);
+  nbr->next = sr->rip_nbrs;
+  sr->rip_nbrs = nbr;
+  return nbr;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_nbr_expire() 
+ * @brief function withdraws every path through a neighbor that went
+ * silent, in one pass over its own routes. A route that loses its gateway
+ * fails over to an equal-cost path or becomes unreachable. Called with
+ * rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param nbr: the neighbor
+ *---------------------------------------------------------------------*/
+static void sr_rip_nbr_expire(struct sr_instance *sr, struct sr_rip_nbr *nbr) {
+  nbr->alive = 0;
+  nbr->num_digests = 0;
+  sr->rip_nbr_expiries++;
+  while(nbr->num_routes > 0){
+    struct sr_rt* entry = nbr->routes[nbr->num_routes - 1];
+    struct sr_rt_link* link = sr_rt_link_of(entry, nbr);
+    if(link == &(entry->backup.link)){
+      sr_rt_drop_backup(sr, entry);
+    }
+    else if(link != &(entry->link)){
+      sr_rt_drop_alt(sr, entry, (struct sr_rt_path*)((char*)link - offsetof(struct sr_rt_path, link)) - entry->alt);
+    }
+    else{
+      if(entry->metric != INFINITY){
+        sr_rt_withdraw(sr, entry);
+      }
+      if(entry->link.nbr == nbr){
+        sr_rt_link_detach(&(entry->link));
+      }
+    }
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_nbr_down() 
+ * @brief function expires a neighbor the liveness detection lost, without
+ * waiting for SR_RIP_TIMEOUT_MS, and tells the other neighbors right away.
+ * @param sr: pointer to simple router state.
+ * @param ip: source IP of its responses
+ * @param if_name: interface they are received on
+ *---------------------------------------------------------------------*/
+void sr_rip_nbr_down(struct sr_instance *sr, uint32_t ip, const char *if_name) {
+  struct sr_rip_nbr* nbr;
+  bool changed;
+
+  sr_rt_lock(sr);
+  uint32_t seq = sr->rt_seq;
+  for(nbr = sr->rip_nbrs; nbr; nbr = nbr->next){
+    if(nbr->alive && nbr->ip == ip && strcmp(nbr->interface, if_name) == 0){
+      sr_rip_nbr_expire(sr, nbr);
+    }
+  }
+  changed = sr->rt_seq != seq;
+  sr_rt_unlock(sr);
+
+  if(changed){
+    sr_rip_trigger_now(sr);
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_digest() 
+ * @brief function hashes a RIP payload (FNV-1a, 64 bit)
+ * @param payload: the RIP header and entries
+ * @param len: length of the payload
+ * @return: the digest
+ *---------------------------------------------------------------------*/
+static uint64_t sr_rip_digest(const uint8_t *payload, unsigned int len) {
+  uint64_t h = 14695981039346656037ULL;
+  unsigned int i;
+  for(i = 0; i < len; i++){
+    h ^= payload[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_digest_of() 
+ * @brief function finds the digest slot of a neighbor's response packet
+ * by its first entry. A slot recorded before the last routing table
+ * change, backup paths included, can no longer match anything, so it is
+ * reused for a packet that has none. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param nbr: the neighbor
+ * @param rip: the packet
+ * @param num_entries: number of entries in it
+ * @param create: get a slot for a packet that has none
+ * @return: the slot, NULL if it has none
+ *---------------------------------------------------------------------*/
+static struct sr_rip_digest* sr_rip_digest_of(struct sr_instance *sr, struct sr_rip_nbr *nbr,
+    sr_rip_pkt_t *rip, unsigned int num_entries, bool create) {
+  uint32_t address = num_entries ? rip->entries[0].address : 0;
+  uint32_t mask = num_entries ? rip->entries[0].mask : 0;
+  struct sr_rip_digest* stale = NULL;
+  struct sr_rip_digest* slot;
+  unsigned int i;
+
+  for(i = 0; i < nbr->num_digests; i++){
+    slot = &(nbr->digests[i]);
+    if(slot->key_address == address && slot->key_mask == mask){
+      return slot;
+    }
+    if(stale == NULL && (slot->seq != sr->rt_seq || slot->backup_gen != sr->rt_backup_gen)){
+      stale = slot;
+    }
+  }
+  if(!create){
+    return NULL;
+  }
+  if(stale == NULL){
+    if(nbr->num_digests == nbr->max_digests){
+      nbr->max_digests = nbr->max_digests ? 2 * nbr->max_digests : 4;
+      nbr->digests = (struct sr_rip_digest*)realloc(nbr->digests,
+          nbr->max_digests * sizeof(struct sr_rip_digest));
+      assert(nbr->digests);
+    }
+    stale = &(nbr->digests[nbr->num_digests++]);
+  }
+  stale->key_address = address;
+  stale->key_mask = mask;
+  return stale;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_nbr_check() 
+ * @brief function expires the neighbors not heard from for
+ * SR_RIP_TIMEOUT_MS. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+static void sr_rip_nbr_check(struct sr_instance *sr) {
+  uint64_t now = sr_now_ms();
+  struct sr_rip_nbr* nbr;
+  for(nbr = sr->rip_nbrs; nbr; nbr = nbr->next){
+    if(nbr->alive && now - nbr->last_heard_ms > SR_RIP_TIMEOUT_MS){
+      sr_rip_nbr_expire(sr, nbr);
+    }
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_interface_down() 
+ * @brief function withdraws the routes through a down interface: their
+ * paths on it are dropped, and a route that loses its next hop fails over
+ * to another path or is set to INFINITY. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param if_name: the interface that is down
+ * @return: true if the routing table changed
+ *---------------------------------------------------------------------*/
+static bool sr_rt_interface_down(struct sr_instance *sr, const char *if_name) {
+  uint32_t seq = sr->rt_seq;
+  /*you should delete all the routing entries which use this interface to send packets*/
+  struct sr_rt * pointer2 = sr->routing_table;
+  while (pointer2 != NULL) {
+    unsigned int i = pointer2->num_alt;
+    while(i-- > 0){
+      if(strcmp(pointer2->alt[i].interface, if_name)==0){
+        sr_rt_drop_alt(sr, pointer2, i);
+      }
+    }
+    if(pointer2->has_backup && strcmp(pointer2->backup.interface, if_name)==0){
+      sr_rt_drop_backup(sr, pointer2);
+    }
+    if(strcmp(pointer2->interface, if_name)==0 && pointer2->metric != INFINITY){
+      sr_rt_withdraw(sr, pointer2);
+    }
+    pointer2=pointer2->next;
+  }
+  return seq != sr->rt_seq;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_interface_up() 
+ * @brief function refreshes, or restores, the route to the subnet an up
+ * interface is directly connected to. Called with rt_locker held.
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface that is up
+ * @return: true if the routing table changed
+ *---------------------------------------------------------------------*/
+static bool sr_rt_interface_up(struct sr_instance *sr, struct sr_if *interface) {
+  uint32_t seq = sr->rt_seq;
+  /* you should check whether your current routing table contains the subnet this interface is directly connected to.*/
+  struct sr_rt * pointer3 = sr_rt_lookup_prefix(sr, interface->ip, interface->mask);
+  /* If it contains, update the updated time, metric, gateway, and interface in the routing entry*/
+  if(pointer3 != NULL){
+    /* Lab4-Task3 TODO */
+    pointer3->updated_time = time(NULL); /*update time */
+    if(pointer3->metric != 0 || pointer3->gw.s_addr != 0 || strcmp(pointer3->interface, interface->name) != 0){
+      pointer3->metric = 0;
+      pointer3->gw.s_addr = 0;
+      strcpy(pointer3->interface, interface->name);
+      sr_rt_clear_alts(pointer3);
+      sr_rt_drop_backup(sr, pointer3);
+      sr_rt_link_detach(&(pointer3->link));
+      sr_rt_damp_clear(pointer3);
+      sr_rt_mark_changed(sr, pointer3);
+    }
+    /* End TODO */
+  }
+  /* Otherwise, add this subnet to your routing table*/
+  else{
+    struct in_addr address;
+    address.s_addr = interface->ip;
+    struct in_addr gw;
+    gw.s_addr = 0x0;
+    struct in_addr mask;
+    mask.s_addr = interface->mask;
+    sr_add_rt_entry(sr,address,gw,mask,0,interface->name);
+  }
+  return seq != sr->rt_seq;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_interface_event() 
+ * @brief function reacts to an interface going up or down as it happens,
+ * instead of at the next periodic update: routes through a down interface
+ * are withdrawn (and the forwarding table republished), the connected
+ * route of an up interface is restored, and neighbors are told right
+ * away with an immediate triggered update.
+ * @param sr: pointer to simple router state.
+ * @param if_name: the interface
+ * @param status: 0 - interface down; 1 - interface up
+ *---------------------------------------------------------------------*/
+void sr_rt_interface_event(struct sr_instance *sr, const char *if_name, uint32_t status) {
+  struct sr_if* interface = sr_get_interface(sr, if_name);
+  bool changed;
+
+  if(interface == NULL){
+    return;
+  }
+  sr_rt_lock(sr);
+  sr->rt_if_events++;
+  if(status == 0){
+    changed = sr_rt_interface_down(sr, interface->name);
+  }
+  else{
+    changed = sr_rt_interface_up(sr, interface);
+  }
+  sr_rt_unlock(sr);
+
+  if(changed){
+    sr_rip_trigger_now(sr);
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_periodic() 
+ * @brief function checks the status of all interfaces and updates the
+ * routing table. The regular RIP responses go out on their own
+ * per-interface timers; what changed here goes out as a triggered update.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+static void sr_rip_periodic(struct sr_instance *sr) {
+  sr_rt_lock(sr);
+  uint32_t seq = sr->rt_seq;
+
+  /* 2 Routes learned from a neighbor live as long as the neighbor does */
+  sr_rip_nbr_check(sr);
+
+  struct sr_rt * pointer1 = sr->routing_table;
+  /* 2.a Local routes still age by themselves */
+  while (pointer1 != NULL) {
+    /* check whether this entry has expired (Current_time – Updated_time >= 20 seconds).*/
+    if(pointer1->link.nbr == NULL &&
+       difftime(time(NULL), pointer1->updated_time) > 20 && pointer1->metric != INFINITY){
+      /* 2.b If expired, fail over to another path or delete it from the routing table*/
+      sr_rt_withdraw(sr, pointer1);
+    }
+    pointer1=pointer1->next;
+  }
+  /* 2.c Advertise again the damped routes that have been stable long enough */
+  sr_rt_damp_reuse(sr);
+  /* 2.d Forget the routes that have been unreachable long enough */
+  sr_rt_flush(sr);
+
+  struct sr_if* interface = sr->if_list;
+  /* 3 Checking the status of the router's own interfaces*/
+  while(interface!=NULL){
+    /* 3.a If the status of an interface is down*/
+    if(sr_obtain_interface_status(sr,interface->name)==0){
+      sr_rt_interface_down(sr, interface->name);
+    }
+    /* 3.b If the status of an interface is up*/
+    else{
+      sr_rt_interface_up(sr, interface);
+    }
+    interface = interface->next;
+  }
+  bool changed = seq != sr->rt_seq;
+  sr_rt_unlock(sr);
+
+  /* 4 Tell the neighbors what changed */
+  if(changed){
+    sr_rip_schedule_trigger(sr);
+  }
+  sr_print_routing_table(sr);   
+  sr_print_stats(sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_next_update() 
+ * @brief function schedules the next regular update of an interface one
+ * period away, give or take a random jitter, so that routers started
+ * together drift apart instead of updating in step (RFC 2453, 3.8). The
+ * interval the last update actually took goes into the jitter histogram.
+ * Called with rip_timer_lock held.
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface whose update is going out
+ * @param now: sr_now_ms()
+ *---------------------------------------------------------------------*/
+static void sr_rip_next_update(struct sr_instance *sr, struct sr_if *interface, uint64_t now) {
+  int jitter = sr->rip_jitter_ms;
+
+  if(interface->rip_last_ms != 0){
+    int offset = (int)(now - interface->rip_last_ms) - (int)sr->rip_update_ms;
+    if(offset > jitter){
+      sr->rip_jitter_late++;
+    }
+    else{
+      if(offset < -jitter){
+        offset = -jitter;
+      }
+      sr->rip_jitter_hist[(offset + jitter) * SR_RIP_JITTER_BUCKETS / (2 * jitter + 1)]++;
+    }
+  }
+  interface->rip_last_ms = now;
+  interface->rip_next_ms = now + sr->rip_update_ms - jitter + rand() % (2 * jitter + 1);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_schedule_trigger() 
+ * @brief function asks for a triggered update. The first change opens a
+ * randomized hold-down window; changes inside the window are folded into
+ * the update that goes out when it closes.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_rip_schedule_trigger(struct sr_instance *sr){
+  pthread_mutex_lock(&(sr->rip_timer_lock));
+  if(sr->rip_trigger_at != 0){
+    sr->rip_triggers_suppressed++;
+  }
+  else{
+    unsigned int delay = sr->rip_trigger_min_ms;
+    if(sr->rip_trigger_max_ms > sr->rip_trigger_min_ms){
+      delay += rand() % (sr->rip_trigger_max_ms - sr->rip_trigger_min_ms + 1);
+    }
+    sr->rip_trigger_at = sr_now_ms() + delay;
+    pthread_cond_signal(&(sr->rip_timer_cond));
+  }
+  pthread_mutex_unlock(&(sr->rip_timer_lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_trigger_now() 
+ * @brief function sends the triggered update now, skipping the hold-down
+ * window, for events neighbors must learn about at once.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_rip_trigger_now(struct sr_instance *sr){
+  pthread_mutex_lock(&(sr->rip_timer_lock));
+  if(sr->rip_trigger_at != 0){
+    sr->rip_triggers_suppressed++;
+  }
+  sr->rip_trigger_at = sr_now_ms();
+  pthread_cond_signal(&(sr->rip_timer_cond));
+  pthread_mutex_unlock(&(sr->rip_timer_lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_print_stats() 
+ * @brief function prints the RIP update counters and routing table
+ * occupancy.
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void sr_rip_print_stats(struct sr_instance *sr){
+  pthread_mutex_lock(&(sr->rip_timer_lock));
+  printf("RIP triggered updates sent: %lu, suppressed: %lu\n",
+         sr->rip_triggers_sent, sr->rip_triggers_suppressed);
+  int jitter = sr->rip_jitter_ms, b;
+  printf("RIP update intervals, ms off the %u ms period:", sr->rip_update_ms);
+  for(b = 0; b < SR_RIP_JITTER_BUCKETS; b++){
+    if(sr->rip_jitter_hist[b] > 0){
+      printf(" [%d,%d) %lu", -jitter + b * (2 * jitter + 1) / SR_RIP_JITTER_BUCKETS,
+             -jitter + (b + 1) * (2 * jitter + 1) / SR_RIP_JITTER_BUCKETS, sr->rip_jitter_hist[b]);
+    }
+  }
+  printf(" late %lu\n", sr->rip_jitter_late);
+  pthread_mutex_unlock(&(sr->rip_timer_lock));
+
+  pthread_mutex_lock(&(sr->rip_send_lock));
+  printf("RIP response templates built: %lu, reused: %lu\n",
+         sr->rip_tmpl_builds, sr->rip_tmpl_reuses);
+  if(sr->rip_sum_routes > 0){
+    printf("RIP summarization: %lu routes advertised as %lu entries\n",
+           sr->rip_sum_routes, sr->rip_sum_entries);
+  }
+  pthread_mutex_unlock(&(sr->rip_send_lock));
+
+  sr_rt_lock(sr);
+  printf("Interface events: %lu, backup failovers: %lu\n", sr->rt_if_events, sr->rt_failovers);
+  printf("Flap damping: %lu flaps, %lu suppressions\n", sr->rt_damp_flaps, sr->rt_damp_suppressions);
+  struct sr_rip_nbr* nbr;
+  uint64_t now = sr_now_ms();
+  struct sr_rip_import* imp;
+  for(imp = sr->rip_imports; imp; imp = imp->next){
+    printf("RIP import on %s: %u rules, %lu permitted, %lu denied, max-prefix %u (%s)\n",
+           imp->interface, imp->num_rules, imp->permitted, imp->denied, imp->max_prefix,
+           imp->max_prefix_action == rip_max_prefix_shutdown ? "shutdown" : "warn");
+  }
+  printf("RIP neighbors (%lu expiries, %lu unchanged responses skipped):\n",
+         sr->rip_nbr_expiries, sr->rip_dup_skips);
+  for(nbr = sr->rip_nbrs; nbr; nbr = nbr->next){
+    struct in_addr addr;
+    addr.s_addr = nbr->ip;
+    printf("  %s on %s: %s, heard %llu ms ago, %u routes, %lu updates (%lu skipped)\n",
+           inet_ntoa(addr), nbr->interface, nbr->alive ? "up" : "down",
+           (unsigned long long)(now - nbr->last_heard_ms), nbr->num_routes,
+           nbr->updates, nbr->skipped);
+    if(nbr->denied > 0 || nbr->shutdowns > 0){
+      printf("    %lu entries denied, %lu max-prefix shutdowns%s\n",
+             nbr->denied, nbr->shutdowns, nbr->shutdown_until_ms > now ? ", shut down" : "");
+    }
+  }
+  printf("Routing table lock: %lu holds, avg %llu us, max %llu us\n",
+         sr->rt_lock_holds,
+         (unsigned long long)(sr->rt_lock_holds ? sr->rt_lock_hold_us / sr->rt_lock_holds : 0),
+         (unsigned long long)sr->rt_lock_hold_max_us);
+  printf("Routes: %lu, flushed: %lu, slabs: %lu (%lu of %lu entries in use)\n",
+         sr->rt_count, sr->rt_flushed, sr->rt_slab_count, sr->rt_count,
+         sr->rt_slab_count * SR_RT_SLAB_ENTRIES);
+  sr_rt_unlock(sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_timeout() 
+ * @brief function runs the RIP timers: table maintenance every period,
+ * the jittered regular update of each interface, and the triggered update
+ * when its window closes. All run on the monotonic millisecond clock.
+ * @param sr_ptr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void *sr_rip_timeout(void *sr_ptr) {
+  struct sr_instance *sr = sr_ptr;
+  uint64_t next_periodic = sr_now_ms() + sr->rip_update_ms;
+  while (1) {
+    bool periodic = false, triggered = false;
+    struct sr_if *due = NULL;
+    struct sr_if *interface;
+
+    /* 1 Sleep until maintenance, an interface's regular update or a
+       triggered update is due */
+    pthread_mutex_lock(&(sr->rip_timer_lock));
+    while (1) {
+      uint64_t now = sr_now_ms();
+      uint64_t wake = next_periodic;
+      for (interface = sr->if_list; interface != NULL; interface = interface->next) {
+        /* A new interface starts at a random point of the period */
+        if (interface->rip_next_ms == 0) {
+          interface->rip_next_ms = now + rand() % (sr->rip_update_ms + 1);
+        }
+        if (interface->rip_next_ms < wake) {
+          wake = interface->rip_next_ms;
+        }
+      }
+      if (sr->rip_trigger_at != 0 && sr->rip_trigger_at < wake) {
+        wake = sr->rip_trigger_at;
+      }
+      if (now >= wake) {
+        break;
+      }
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_sec += (wake - now) / 1000;
+      ts.tv_nsec += ((wake - now) % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&(sr->rip_timer_cond), &(sr->rip_timer_lock), &ts);
+    }
+    uint64_t now = sr_now_ms();
+    if (now >= next_periodic) {
+      periodic = true;
+      next_periodic = now + sr->rip_update_ms;
+    }
+    else if (sr->rip_trigger_at != 0 && now >= sr->rip_trigger_at) {
+      triggered = true;
+      sr->rip_trigger_at = 0;
+      sr->rip_triggers_sent++;
+    }
+    else {
+      for (interface = sr->if_list; interface != NULL; interface = interface->next) {
+        if (now >= interface->rip_next_ms) {
+          due = interface;
+          sr_rip_next_update(sr, interface, now);
+          break;
+        }
+      }
+    }
+    pthread_mutex_unlock(&(sr->rip_timer_lock));
+
+    /* 2 update the routing table */
+    if (periodic) {
+      sr_rip_periodic(sr);
+    }
+    /* 3 send the triggered update, with only what changed */
+    else if (triggered) {
+      send_rip_triggered_response(sr);
+    }
+    /* 4 or send the regular RIP response of one interface */
+    else if (due != NULL) {
+      sr_rip_send_full(sr, due);
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_fill_headers() 
+ * @brief function fills in the Ethernet, IP, UDP and RIP headers of a RIP
+ * packet carrying num_entries entries, sent broadcast out of interface
+ * @param block: buffer large enough for the whole packet
+ * @param interface: the interface the packet is sent on
+ * @param command: RIP command, 1 request / 2 response
+ * @param num_entries: number of route entries that follow the RIP header
+ * @return: length of the whole packet
+ *---------------------------------------------------------------------*/
+static unsigned int sr_rip_fill_headers(uint8_t *block, struct sr_if *interface,
+    uint8_t command, unsigned int num_entries){
+  unsigned int rip_len = SR_RIP_HDR_LEN + num_entries * sizeof(struct entry);
+  unsigned int packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t) + rip_len;
+
+  /* 1.a Set Ethernet header */
+  sr_ethernet_hdr_t* ethernet_hdr = (sr_ethernet_hdr_t*)block;
+  memcpy(ethernet_hdr->ether_shost, interface->addr, ETHER_ADDR_LEN);
+  memset(ethernet_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+  ethernet_hdr->ether_type = htons(ethertype_ip);
+
+  /* 1.b Set IP header */  
+  sr_ip_hdr_t* pkt = (sr_ip_hdr_t *)(block + sizeof(sr_ethernet_hdr_t));
+  pkt->ip_hl = 0x5;
+  pkt->ip_v  = 0x4;
+  pkt->ip_tos = iptos;
+  pkt->ip_len = htons((uint16_t) (sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t) + rip_len));
+  pkt->ip_id = htons(ipid);
+  pkt->ip_off = htons(ipoff);
+  pkt->ip_ttl = ipttl;
+  pkt->ip_p = ip_protocol_udp;
+  pkt->ip_sum = 0;
+  pkt->ip_src = interface->ip;
+  pkt->ip_dst = htonl(broadcast_ip);
+  pkt->ip_sum = cksum(((void *) pkt), sizeof(sr_ip_hdr_t));
+
+  /*1.c Set UDP header*/
+  sr_udp_hdr_t* udp_hdr = (sr_udp_hdr_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+  udp_hdr->port_dst = 520;
+  udp_hdr->port_src = 520;
+  udp_hdr->udp_len = htons((uint16_t) (sizeof(sr_udp_hdr_t) + rip_len));
+  udp_hdr->udp_sum = 0;
+  udp_hdr->udp_sum = cksum(((void *) udp_hdr), sizeof(sr_udp_hdr_t));
+
+  /*1.d Set RIP header*/
+  sr_rip_pkt_t* rip_hdr = (sr_rip_pkt_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
+  rip_hdr->command = command;
+  rip_hdr->version = 2;
+  rip_hdr->unused = 0;
+
+  return packet_len;
+}
+
+/*---------------------------------------------------------------------
+ * Method: send_rip_request() 
+ * @brief function send RIP request to all its neighbors    
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void send_rip_request(struct sr_instance *sr){
+  sr_rt_lock(sr);
+
+  struct sr_if* interface = sr->if_list;
+  /*1 Send RIP request to every interface(i.e., neighbor)*/
+  while(interface!=NULL){
+    uint8_t block[SR_RIP_MAX_PACKET_LEN];
+    memset(block, 0, sizeof(block));
+
+    /*1.a-d Set the headers of a request with a single entry*/
+    unsigned int packet_len = sr_rip_fill_headers(block, interface, 1, 1);
+    sr_rip_pkt_t* rip_hdr = (sr_rip_pkt_t *)(block + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
+    rip_hdr->entries[0].metric = INFINITY;
+
+    /*1.e Send the request*/
+    sr_send_packet(sr, block, packet_len, interface->name );
+    interface = interface->next;
+  }
+  sr_rt_unlock(sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_summarizes() 
+ * @brief function tells whether the responses of an interface are
+ * summarized: auto summarization is on, an aggregate is configured on it,
+ * or a summary it advertised still has to be withdrawn
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface
+ *---------------------------------------------------------------------*/
+static bool sr_rip_summarizes(struct sr_instance *sr, struct sr_if *interface){
+  struct sr_rip_aggregate* agg;
+  if(sr->rip_auto_summary || interface->rip_num_sums > 0){
+    return true;
+  }
+  for(agg = sr->rip_aggregates; agg; agg = agg->next){
+    if(strcmp(agg->interface, interface->name) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_summarize() 
+ * @brief function replaces the entries of a response by their summaries.
+ * Each aggregate configured on the interface stands for the entries it
+ * covers, at the lowest metric among them, and is left out once none is
+ * reachable. With auto summarization, two reachable entries that are the
+ * halves of one prefix and share a next hop are merged into it, again at
+ * the lower metric, until no more merge. A summary the interface
+ * advertised and no longer does is withdrawn with INFINITY, in every
+ * response for rip_flush_secs, as a route is before it is flushed.
+ * Called with rip_send_lock held.
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface the response is sent on
+ * @param entries: the entries, with room for the aggregates and the
+ * withdrawals
+ * @param n: number of entries
+ * @return: number of entries left
+ *---------------------------------------------------------------------*/
+static unsigned int sr_rip_summarize(struct sr_instance *sr, struct sr_if *interface,
+    struct entry *entries, unsigned int n){
+  uint8_t* summary;
+  struct sr_if_rip_sum* sums;
+  unsigned int num_sums = 0;
+  struct sr_rip_aggregate* agg;
+  unsigned int i, j, k, routes = n;
+  unsigned int room = n + interface->rip_num_sums + 1;
+  time_t now = time(NULL);
+  bool merged;
+
+  for(agg = sr->rip_aggregates; agg; agg = agg->next){
+    room++;
+  }
+  summary = (uint8_t*)calloc(room, 1);
+  assert(summary);
+  /*1 Configured aggregates, INFINITY marks an entry as gone*/
+  for(agg = sr->rip_aggregates; agg; agg = agg->next){
+    uint32_t metric = INFINITY;
+    if(strcmp(agg->interface, interface->name) != 0){
+      continue;
+    }
+    for(i = 0; i < routes; i++){
+      if(summary[i] != 2 && (entries[i].address & agg->mask) == agg->dest &&
+         ntohl(entries[i].mask) >= ntohl(agg->mask)){
+        if(entries[i].metric < metric){
+          metric = entries[i].metric;
+        }
+        summary[i] = 2;
+      }
+    }
+    if(metric < INFINITY){
+      entries[n].afi = htons(2);
+      entries[n].tag = 0;
+      entries[n].address = agg->dest;
+      entries[n].mask = agg->mask;
+      entries[n].next_hop = 0;
+      entries[n].metric = metric;
+      summary[n++] = 1;
+    }
+  }
+
+  /*2 Automatic summaries of sibling prefixes*/
+  merged = sr->rip_auto_summary;
+  while(merged){
+    merged = false;
+    for(i = 0; i < n; i++){
+      uint32_t mask = ntohl(entries[i].mask);
+      uint32_t low = mask & (~mask + 1);
+      if(summary[i] == 2 || entries[i].metric >= INFINITY || mask == 0){
+        continue;
+      }
+      for(j = i + 1; j < n; j++){
+        if(summary[j] != 2 && entries[j].metric < INFINITY && entries[j].mask == entries[i].mask &&
+           entries[j].next_hop == entries[i].next_hop &&
+           (ntohl(entries[i].address) ^ ntohl(entries[j].address)) == low){
+          break;
+        }
+      }
+      if(j == n){
+        continue;
+      }
+      /* the parent may already be advertised on its own */
+      uint32_t parent_mask = htonl(mask & ~low);
+      uint32_t parent = entries[i].address & parent_mask;
+      for(k = 0; k < n; k++){
+        if(summary[k] != 2 && entries[k].address == parent && entries[k].mask == parent_mask){
+          break;
+        }
+      }
+      if(k < n){
+        continue;
+      }
+      entries[i].address = parent;
+      entries[i].mask = parent_mask;
+      if(entries[j].metric < entries[i].metric){
+        entries[i].metric = entries[j].metric;
+      }
+      summary[i] = 1;
+      summary[j] = 2;
+      merged = true;
+    }
+  }
+
+  /*3 Withdraw the summaries that went away, until they are flushed*/
+  sums = (struct sr_if_rip_sum*)malloc((n + interface->rip_num_sums + 1) * sizeof(struct sr_if_rip_sum));
+  assert(sums);
+  for(k = 0; k < interface->rip_num_sums; k++){
+    struct sr_if_rip_sum* sum = &(interface->rip_sums[k]);
+    for(i = 0; i < n; i++){
+      if(summary[i] != 2 && entries[i].address == sum->dest && entries[i].mask == sum->mask){
+        break;
+      }
+    }
+    if(i == n){
+      if(sum->withdrawn_time == 0){
+        sum->withdrawn_time = now;
+      }
+      if(sr->rip_flush_secs != 0 && difftime(now, sum->withdrawn_time) >= sr->rip_flush_secs){
+        continue;
+      }
+      sums[num_sums++] = *sum;
+      entries[n].afi = htons(2);
+      entries[n].tag = 0;
+      entries[n].address = sum->dest;
+      entries[n].mask = sum->mask;
+      entries[n].next_hop = 0;
+      entries[n].metric = INFINITY;
+      summary[n++] = 0;
+    }
+  }
+
+  /*4 Remember the summaries advertised, and drop the entries they replace*/
+  for(i = 0, j = 0; i < n; i++){
+    if(summary[i] == 2){
+      continue;
+    }
+    if(summary[i] == 1){
+      sums[num_sums].dest = entries[i].address;
+      sums[num_sums].mask = entries[i].mask;
+      sums[num_sums].withdrawn_time = 0;
+      num_sums++;
+    }
+    entries[j++] = entries[i];
+  }
+  free(interface->rip_sums);
+  interface->rip_sums = sums;
+  interface->rip_num_sums = num_sums;
+  free(summary);
+  sr->rip_sum_routes += routes;
+  sr->rip_sum_entries += j;
+  return j;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_sums_expire() 
+ * @brief function tells when the first summary an interface is still
+ * withdrawing runs out, so a response built now stops being current
+ * @param sr: pointer to simple router state.
+ * @param interface: the interface
+ * @return: that time, 0 if there is none
+ *---------------------------------------------------------------------*/
+static time_t sr_rip_sums_expire(struct sr_instance *sr, struct sr_if *interface){
+  time_t expires = 0;
+  unsigned int k;
+
+  if(sr->rip_flush_secs == 0){
+    return 0;
+  }
+  for(k = 0; k < interface->rip_num_sums; k++){
+    time_t t = interface->rip_sums[k].withdrawn_time;
+    if(t != 0 && (expires == 0 || t + (time_t)sr->rip_flush_secs < expires)){
+      expires = t + sr->rip_flush_secs;
+    }
+  }
+  return expires;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_build_routes() 
+ * @brief function serializes the snapshot routes that are advertised out
+ * of interface, summarized when configured, into wire-ready RIP
+ * responses. The routes are split into as many packets as needed, each
+ * carrying at most MAX_NUM_ENTRIES entries and sized to what it carries.
+ * Called with rip_send_lock held.
+ * @param sr: pointer to simple router state.
+ * @param snap: the routes
+ * @param interface: the interface the responses are sent on
+ * @param keepalive: send an empty response if there is no route
+ * @return: list of packets, NULL if there is nothing to send
+ *---------------------------------------------------------------------*/
+static struct sr_packet* sr_rip_build_routes(struct sr_instance *sr, struct sr_rt_snapshot *snap,
+    struct sr_if *interface, bool keepalive){
+  struct sr_packet* head = NULL;
+  struct sr_packet** tail = &head;
+  struct sr_packet* pkt = NULL;
+  sr_rip_pkt_t* rip_hdr = NULL;
+  struct sr_rip_aggregate* agg;
+  struct entry* entries;
+  unsigned int i = 0;
+  unsigned int n = 0, len = 0, room = snap->len + interface->rip_num_sums;
+
+  for(agg = sr->rip_aggregates; agg; agg = agg->next){
+    room++;
+  }
+  entries = (struct entry*)malloc((room + 1) * sizeof(struct entry));
+  assert(entries);
+
+  /*1 Split horizon: do not advertise a route back out of any interface
+    one of its paths uses*/
+  for(n = 0; n < snap->len; n++){
+    struct sr_rt * table = &(snap->entries[n]);
+    if(!sr_rt_uses_interface(table, interface->name)){
+      entries[len].afi = htons(2);
+      entries[len].tag = 0;
+      entries[len].address = table->dest.s_addr;
+      entries[len].mask = table->mask.s_addr;
+      entries[len].next_hop = table->gw.s_addr;
+      entries[len].metric = table->damp.suppressed ? INFINITY : table->metric;
+      len++;
+    }
+  }
+  if(sr_rip_summarizes(sr, interface)){
+    len = sr_rip_summarize(sr, interface, entries, len);
+  }
+
+  for(n = 0; n < len || pkt==NULL; n++){
+    /*2 Start a new response when the last one is full; a full dump always
+      has at least one, an empty response still tells the neighbors we
+      are alive*/
+    if(pkt==NULL && (n < len || keepalive)){
+      pkt = (struct sr_packet*)calloc(1, sizeof(struct sr_packet));
+      assert(pkt);
+      pkt->buf = (uint8_t*)calloc(1, SR_RIP_MAX_PACKET_LEN);
+      assert(pkt->buf);
+      rip_hdr = (sr_rip_pkt_t *)(pkt->buf + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t));
+      i = 0;
+    }
+    if(n == len){
+      break;
+    }
+    rip_hdr->entries[i] = entries[n];
+    i = i+1;
+    /*3 Close a full RIP response*/
+    if(i == MAX_NUM_ENTRIES){
+      pkt->len = sr_rip_fill_headers(pkt->buf, interface, 2, i);
+      *tail = pkt;
+      tail = &(pkt->next);
+      pkt = NULL;
+    }
+  }
+
+  /*4 Close the remaining entries, or the empty keepalive of a full dump*/
+  if(pkt!=NULL){
+    if(i > 0 || (head==NULL && keepalive)){
+      pkt->len = sr_rip_fill_headers(pkt->buf, interface, 2, i);
+      *tail = pkt;
+    }
+    else{
+      free(pkt->buf);
+      free(pkt);
+    }
+  }
+  free(entries);
+  return head;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_free_packets() 
+ * @brief function frees a list of packets built by sr_rip_build_routes()
+ * @param pkts: the list
+ *---------------------------------------------------------------------*/
+static void sr_rip_free_packets(struct sr_packet *pkts){
+  while(pkts){
+    struct sr_packet* next = pkts->next;
+    free(pkts->buf);
+    free(pkts);
+    pkts = next;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_tmpl_stale() 
+ * @brief function tells whether the RIP response template of interface
+ * was built for another routing table generation or interface address,
+ * or carries a summary withdrawal that has run out
+ * @param interface: the interface
+ * @param seq: current sr->rt_seq
+ * @param now: current time
+ *---------------------------------------------------------------------*/
+static bool sr_rip_tmpl_stale(struct sr_if *interface, uint32_t seq, time_t now){
+  return interface->rip_tmpl==NULL || interface->rip_tmpl_seq != seq ||
+         interface->rip_tmpl_ip != interface->ip ||
+         memcmp(interface->rip_tmpl_mac, interface->addr, ETHER_ADDR_LEN)!=0 ||
+         (interface->rip_tmpl_expires != 0 && now >= interface->rip_tmpl_expires);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_send_full() 
+ * @brief function sends RIP responses with the whole routing table. The
+ * responses of each interface are kept as a template and only rebuilt,
+ * from a snapshot of the routing table, when the table or the interface
+ * address changed since they were built. Nothing is serialized or sent
+ * while holding rt_locker.
+ * @param sr: pointer to simple router state.
+ * @param only: the interface to send on, NULL for all of them
+ *---------------------------------------------------------------------*/
+static void sr_rip_send_full(struct sr_instance *sr, struct sr_if *only){
+  struct sr_rt_snapshot snap;
+  struct sr_if* interface;
+  uint32_t seq;
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&(sr->rip_send_lock));
+  /*1 Only copy the table if a template has to be rebuilt*/
+  sr_rt_lock(sr);
+  seq = sr->rt_seq;
+  snap.entries = NULL;
+  snap.len = 0;
+  for(interface = sr->if_list; interface!=NULL; interface = interface->next){
+    if((only==NULL || interface==only) && snap.entries==NULL &&
+       sr_rip_tmpl_stale(interface, seq, now)){
+      sr_rt_take_snapshot(sr, 0, &snap);
+    }
+  }
+  sr_rt_unlock(sr);
+
+  interface = sr->if_list;
+  /* 2 Send response to every interface (i.e., neighbor)*/
+  while(interface!=NULL){
+    if(only!=NULL && interface!=only){
+      interface = interface->next;
+      continue;
+    }
+    /*2.a Rebuild a stale template*/
+    if(sr_rip_tmpl_stale(interface, seq, now)){
+      sr_rip_free_packets(interface->rip_tmpl);
+      interface->rip_tmpl = sr_rip_build_routes(sr, &snap, interface, true);
+      interface->rip_tmpl_seq = seq;
+      interface->rip_tmpl_expires = sr_rip_sums_expire(sr, interface);
+      interface->rip_tmpl_ip = interface->ip;
+      memcpy(interface->rip_tmpl_mac, interface->addr, ETHER_ADDR_LEN);
+      sr->rip_tmpl_builds++;
+    }
+    else{
+      sr->rip_tmpl_reuses++;
+    }
+    /*2.b and transmit it as is*/
+    sr_send_packet_batch(sr, interface->rip_tmpl, interface->name);
+    interface = interface->next;
+  }
+  /* A dump on every interface covers the pending changes */
+  if(only==NULL){
+    sr->rip_trigger_seq = seq;
+  }
+  pthread_mutex_unlock(&(sr->rip_send_lock));
+  sr_rt_free_snapshot(&snap);
+}
+
+/*---------------------------------------------------------------------
+ * Method: send_rip_response() 
+ * @brief function send RIP response with the whole routing table to all
+ * its neighbors
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void send_rip_response(struct sr_instance *sr){
+  sr_rip_send_full(sr, NULL);
+}
+
+/*---------------------------------------------------------------------
+ * Method: send_rip_triggered_response() 
+ * @brief function send RIP response to all its neighbors carrying only
+ * the routes that changed since the last update went out
+ * @param sr: pointer to simple router state.
+ *---------------------------------------------------------------------*/
+void send_rip_triggered_response(struct sr_instance *sr){
+  struct sr_rt_snapshot snap;
+  struct sr_rt_snapshot full;
+  struct sr_if* interface;
+
+  pthread_mutex_lock(&(sr->rip_send_lock));
+  sr_rt_lock(sr);
+  sr_rt_take_snapshot(sr, sr->rip_trigger_seq, &snap);
+  full.entries = NULL;
+  full.len = 0;
+  /* Summaries depend on every route they cover, not just the changed ones */
+  for(interface = sr->if_list; interface!=NULL; interface = interface->next){
+    if(snap.len > 0 && full.entries==NULL && sr_rip_summarizes(sr, interface)){
+      sr_rt_take_snapshot(sr, 0, &full);
+    }
+  }
+  sr_rt_unlock(sr);
+  if(snap.len > 0){
+    for(interface = sr->if_list; interface!=NULL; interface = interface->next){
+      struct sr_packet* pkts = sr_rip_summarizes(sr, interface) ?
+          sr_rip_build_routes(sr, &full, interface, false) :
+          sr_rip_build_routes(sr, &snap, interface, false);
+      sr_send_packet_batch(sr, pkts, interface->name);
+      sr_rip_free_packets(pkts);
+    }
+  }
+  sr->rip_trigger_seq = snap.seq;
+  pthread_mutex_unlock(&(sr->rip_send_lock));
+  sr_rt_free_snapshot(&snap);
+  sr_rt_free_snapshot(&full);
+}
+
+/*---------------------------------------------------------------------
+ * Method: update_route_table() 
+ * @brief function update the routing table based on the received routing entries from neighbors    
+ * @param sr: pointer to simple router state.
+ * @param packet: received RIP response packet.
  * @param len: length of the packet
  * @param interface: interface that receives the RIP response 
  *---------------------------------------------------------------------*/
 void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *interface){
-  pthread_mutex_lock(&(sr->rt_locker));
+  sr_rt_lock(sr);
   sr_rip_pkt_t *rip = (sr_rip_pkt_t *) (packet+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+sizeof(sr_udp_hdr_t));    
   sr_ip_hdr_t *ip = (sr_ip_hdr_t *) (packet+sizeof(sr_ethernet_hdr_t));
+  sr_udp_hdr_t *udp = (sr_udp_hdr_t *) (packet+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
+
+  /* The entry count comes from the UDP length, bounded by what was received */
+  unsigned int rip_len = ntohs(udp->udp_len);
+  unsigned int num_entries = 0;
+  if(len < sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t) + SR_RIP_HDR_LEN ||
+     rip_len < sizeof(sr_udp_hdr_t) + SR_RIP_HDR_LEN){
+    sr_rt_unlock(sr);
+    return;
+  }
+  rip_len -= sizeof(sr_udp_hdr_t);
+  if(rip_len > len - sizeof(sr_ip_hdr_t) - sizeof(sr_udp_hdr_t)){
+    rip_len = len - sizeof(sr_ip_hdr_t) - sizeof(sr_udp_hdr_t);
+  }
+  num_entries = (rip_len - SR_RIP_HDR_LEN) / sizeof(struct entry);
+
+  /* Resolve the advertising neighbor now, so traffic routed through it
+     never has to wait for first-packet ARP */
+  if(sr->arp_warmup){
+    sr_arp_prime(sr, ip->ip_src, interface);
+  }
+
+  /* Hearing from the neighbor keeps all of its routes alive at once */
+  struct sr_rip_nbr* nbr = sr_rip_nbr_get(sr, ip->ip_src, interface);
+  struct sr_rip_import* imp = sr_rip_import_of(sr, interface, false);
+  /* A neighbor shut down for sending too many routes stays silent until
+     its restart time */
+  if(nbr->shutdown_until_ms > sr_now_ms()){
+    sr_rt_unlock(sr);
+    return;
+  }
+  if(nbr->updates == 0){
+    sr_bfd_add_session(sr, ip->ip_src, interface);
+  }
+  nbr->last_heard_ms = sr_now_ms();
+  nbr->alive = 1;
+  nbr->updates++;
+
+  uint32_t seq = sr->rt_seq;
+
+  /* A neighbor repeating a packet of its last response, against a table
+     nothing else has changed since, would not change anything either.
+     That includes the backup paths: a path turned down as a backup is
+     offered again once the better one goes */
+  uint64_t digest = sr_rip_digest((uint8_t *)rip, SR_RIP_HDR_LEN + num_entries * sizeof(struct entry));
+  struct sr_rip_digest* last = sr_rip_digest_of(sr, nbr, rip, num_entries, false);
+  if(last != NULL && last->digest == digest && last->seq == sr->rt_seq &&
+     last->backup_gen == sr->rt_backup_gen){
+    nbr->skipped++;
+    sr->rip_dup_skips++;
+    sr_rt_unlock(sr);
+    return;
+  }
 
-  int i = 0;
+  unsigned int i = 0;
   /*flag to identify whether the routing entry is updated*/
   bool changed = false; 
   /*1 For each routing entry in the RIP response packet*/
-  for(i = 0; i<MAX_NUM_ENTRIES; i++){
+  for(i = 0; i<num_entries; i++){
     struct entry e = rip->entries[i];
     /* 1.a If it is valid*/
     if(e.afi!=0){
+      /* and the import policy of the interface permits it */
+      if(!sr_rip_import_permits(imp, e.address, e.mask)){
+        nbr->denied++;
+        imp->denied++;
+        continue;
+      }
+      if(imp != NULL){
+        imp->permitted++;
+      }
       /* 1.b obtain the metric = MIN(received_metric+1, INFINITY),*/
       /* Lab4-Task3 TODO */
       e.metric = (e.metric+1< INFINITY) ? (e.metric+1) : (INFINITY);
       /* End TODO */
-      struct sr_rt * table = sr->routing_table;
-      bool found = false;
       /* 1.c then check whether your routing table contains this routing entry*/
-      while(table!=NULL){
+      struct sr_rt * table = sr_rt_lookup_prefix(sr, e.address, e.mask);
+      bool found = false;
+      /* A prefix the neighbor holds no path for yet counts against the
+         max-prefix limit of the interface. Every path it holds counts,
+         primary, equal-cost and backup alike: each is state the neighbor
+         made us keep */
+      if(imp != NULL && imp->max_prefix > 0 && e.metric < INFINITY &&
+         nbr->num_routes >= imp->max_prefix &&
+         (table == NULL || sr_rt_find_link(table, nbr) == NULL)){
+        struct in_addr addr;
+        addr.s_addr = nbr->ip;
+        if(imp->max_prefix_action == rip_max_prefix_shutdown){
+          fprintf(stderr, "RIP neighbor %s on %s exceeded %u prefixes, shut down for %d s\n",
+                  inet_ntoa(addr), interface, imp->max_prefix, SR_RIP_MAX_PREFIX_RESTART_MS / 1000);
+          sr_rip_nbr_expire(sr, nbr);
+          nbr->shutdown_until_ms = sr_now_ms() + SR_RIP_MAX_PREFIX_RESTART_MS;
+          nbr->shutdowns++;
+          changed = true;
+          break;
+        }
+        if(!nbr->over_limit){
+          fprintf(stderr, "RIP neighbor %s on %s exceeded %u prefixes\n",
+                  inet_ntoa(addr), interface, imp->max_prefix);
+          nbr->over_limit = 1;
+        }
+      }
+      if(table!=NULL){
         /* 1.c.1 if contains this routing entry already.*/
-        if((e.address & e.mask) == (table->dest.s_addr & table->mask.s_addr)){
-          /*1.c.1.i If it has this entry, check if the packet is from the same router as the existing entry*/
-          if(strcmp(table->interface,interface)==0){
-            /*1.c.1.i(1) If true, update the updating time to the new one*/
-            table->updated_time = time(0);
-            
-            /*1.c.1.i(2) If metric == INFINITY or if metric < current metric in routing table, update the metric and set changed as true */
-            /* Lab4-Task3 TODO */ 
-            if(e.metric==INFINITY && table->metric!=INFINITY){
-              changed = true;
-              table->metric=INFINITY;
-            }
+        /*1.c.1.i If it has this entry, check if the packet is from the same router as the existing entry*/
+        if(strcmp(table->interface,interface)==0){
+          /*1.c.1.i(1) If true, update the updating time to the new one*/
+          table->updated_time = time(0);
+          if(table->link.nbr != nbr){
+            sr_rt_link_detach(&(table->link));
+            sr_rt_link_attach(nbr, table, &(table->link));
+          }
+          
+          /*1.c.1.i(2) If metric == INFINITY or if metric < current metric in routing table, update the metric and set changed as true */
+          /* Lab4-Task3 TODO */ 
+          /* A withdrawn route fails over to another path, if any */
+          if(e.metric==INFINITY && table->metric!=INFINITY){
+            changed = true;
+            sr_rt_withdraw(sr, table);
+          }
 
-            if(e.metric < table->metric){
-              changed = true;			
-              table->metric = e.metric; 			
+          if(e.metric < table->metric){
+            changed = true;			
+            table->metric = e.metric; 			
+            sr_rt_clear_alts(table); /* the other paths are longer now */
+            sr_rt_mark_changed(sr, table);
+          }
+          /* End TODO */
+        }
+        /*1.c.1.ii If it has this entry, but not from the same router */
+        else{
+          /* Lab4-Task3 TODO */
+          /*If metric < current metric in routing table*/
+          /*updating all the information in the routing entry, e.g., destination address, metric, update time, gateway, mask and interface*/
+          if(e.metric < table->metric){    
+            changed = true;
+            /* the replaced next hop still works, keep it as the backup */
+            struct sr_rt_path old = {0};
+            struct sr_rip_nbr* old_nbr = table->link.nbr;
+            uint32_t old_metric = table->metric;
+            old.gw = table->gw;
+            memcpy(old.interface, table->interface, sr_IFACE_NAMELEN);
+            if(table->has_backup && table->backup.gw.s_addr == ip->ip_src &&
+               strcmp(table->backup.interface, interface) == 0){
+              sr_rt_drop_backup(sr, table);
+            }
+            table->dest.s_addr = e.address;
+            table->metric = e.metric;
+            table->updated_time  = time(0);
+            table->mask.s_addr = e.mask;
+            table->gw.s_addr = ip->ip_src;
+            memcpy(table->interface, interface, sizeof(unsigned char) * sr_IFACE_NAMELEN);
+            sr_rt_clear_alts(table);
+            sr_rt_link_detach(&(table->link));
+            sr_rt_link_attach(nbr, table, &(table->link));
+            if(old_nbr != NULL && old_metric < INFINITY){
+              sr_rt_offer_backup(sr, table, old_nbr, old.gw.s_addr, old.interface, old_metric);
+            }
+            sr_rt_mark_changed(sr, table);
+          }
+          /* End TODO */
+          /* An equal-cost route from another neighbor is kept as an
+             additional path */
+          else if(e.metric == table->metric && e.metric < INFINITY){
+            int alt = sr_rt_find_alt(table, ip->ip_src, interface);
+            if(alt >= 0){
+              table->alt[alt].updated_time = time(0);
+            }
+            else if(table->num_alt < SR_RT_MAX_PATHS - 1){
+              if(table->has_backup && table->backup.gw.s_addr == ip->ip_src &&
+                 strcmp(table->backup.interface, interface) == 0){
+                sr_rt_drop_backup(sr, table);
+              }
+              struct sr_rt_path* path = &(table->alt[table->num_alt++]);
+              path->gw.s_addr = ip->ip_src;
+              strncpy(path->interface, interface, sr_IFACE_NAMELEN - 1);
+              path->interface[sr_IFACE_NAMELEN - 1] = '\0';
+              path->updated_time = time(0);
+              sr_rt_link_attach(nbr, table, &(path->link));
+              sr_rt_mark_changed(sr, table);
             }
-            /* End TODO */
           }
-          /*1.c.1.ii If it has this entry, but not from the same router */
+          /* and dropped once it is no longer equal. A longer route is
+             kept as the backup, if it is the best of them */
           else{
-            /* Lab4-Task3 TODO */
-            /*If metric < current metric in routing table*/
-            /*updating all the information in the routing entry, e.g., destination address, metric, update time, gateway, mask and interface*/
-            if(e.metric < table->metric){    
-              changed = true;
-              table->dest.s_addr = e.address;
-              table->metric = e.metric;
-              table->updated_time  = time(0);
-              table->mask.s_addr = e.mask;
-              table->gw.s_addr = ip->ip_src;
-              memcpy(table->interface, interface, sizeof(unsigned char) * sr_IFACE_NAMELEN);
+            int alt = sr_rt_find_alt(table, ip->ip_src, interface);
+            if(alt >= 0){
+              sr_rt_drop_alt(sr, table, alt);
+            }
+            if(e.metric < INFINITY){
+              sr_rt_offer_backup(sr, table, nbr, ip->ip_src, interface, e.metric);
+            }
+            else if(table->has_backup && table->backup.gw.s_addr == ip->ip_src &&
+                    strcmp(table->backup.interface, interface) == 0){
+              sr_rt_drop_backup(sr, table);
             }
-            /* End TODO */
-
           }
-          found=true;
-          break;
+
         }
-        table = table->next;
+        found=true;
       }
       /*1.c.2 If not found the entry in current routing table*/
       if(!found){
@@ -549,16 +2460,30 @@ void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int le
         struct in_addr mask;
         mask.s_addr = e.mask;
         sr_add_rt_entry(sr, address,gw, mask, e.metric, interface);
+        sr_rt_link_attach(nbr, sr->rt_tail, &(sr->rt_tail->link));
         /*End TODO*/
       }
     }
   }
+  if(imp != NULL && nbr->num_routes < imp->max_prefix){
+    nbr->over_limit = 0;
+  }
   /*2 Send RIP response through all interfaces if your routing table has changed (trigger updates).*/
-  if(changed){
+  /* The update is coalesced with any other change inside the hold-down window.
+     Changes to suppressed routes are not advertised and need none */
+  if(changed && seq != sr->rt_seq){
     /* Lab4-Task3 TODO */
-    send_rip_response(sr);
+    sr_rip_schedule_trigger(sr);
     /* End TODO */
   }
 
-  pthread_mutex_unlock(&(sr->rt_locker));
+  /* A shut down neighbor's packets must be read again on restart */
+  if(nbr->shutdown_until_ms <= sr_now_ms()){
+    last = sr_rip_digest_of(sr, nbr, rip, num_entries, true);
+    last->digest = digest;
+    last->seq = sr->rt_seq;
+    last->backup_gen = sr->rt_backup_gen;
+  }
+
+  sr_rt_unlock(sr);
 }
@@ -21,6 +21,77 @@
 
 #include "sr_if.h"
 #include "sr_protocol.h"
+
+#define SR_RIP_UPDATE_MS       5000 /* regular update period, per interface */
+#define SR_RIP_JITTER_MS       1000 /* each update is sent within +/- this of it */
+#define SR_RIP_TRIGGER_MIN_MS  1000 /* triggered update hold-down window, */
+#define SR_RIP_TRIGGER_MAX_MS  5000 /* picked at random in [min, max] */
+#define SR_RIP_FLUSH_SECS      20   /* unreachable routes are freed after this */
+#define SR_RT_SLAB_ENTRIES     64   /* routing entries carved per slab */
+#define SR_RT_MAX_PATHS        4    /* equal-cost next hops kept per route */
+#define SR_RIP_TIMEOUT_MS      20000 /* a silent neighbor's routes expire */
+#define SR_RIP_DAMP_HALF_LIFE_MS 15000 /* flap penalty half-life, 0 disables */
+#define SR_RIP_DAMP_PENALTY    1000 /* added each time a route is withdrawn */
+#define SR_RIP_DAMP_SUPPRESS   2000 /* a route is suppressed above this, */
+#define SR_RIP_DAMP_REUSE      750  /* and reused once it decays below this */
+#define SR_RIP_DAMP_MAX        6000 /* penalty ceiling, bounds suppression */
+#define SR_RIP_MAX_PREFIX_RESTART_MS 60000 /* a neighbor shut down for too many routes is ignored this long */
+
+#define SR_RIP_MAX_PACKET_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                               sizeof(sr_udp_hdr_t) + sizeof(sr_rip_pkt_t))
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_slab
+ *
+ * Block of routing entries; unused entries sit on sr->rt_free
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_slab;
+struct sr_rip_nbr;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_link
+ *
+ * Ties a path of a route to the neighbor it was learned from
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_link
+{
+    struct sr_rip_nbr* nbr; /* NULL for local (connected, static) paths */
+    unsigned int index;     /* position of the route in nbr->routes */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_path
+ *
+ * Additional next hop of a route: equal-cost, or the backup
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_path
+{
+    struct in_addr gw;
+    char   interface[sr_IFACE_NAMELEN];
+    time_t updated_time;
+    struct sr_rt_link link;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_damp
+ *
+ * Flap damping state of a RIP-learned route
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_damp
+{
+    uint32_t penalty;    /* as of updated_ms, decays exponentially */
+    uint64_t updated_ms;
+    int suppressed;      /* advertised as INFINITY and kept out of the FIB */
+    unsigned long flaps;
+};
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -36,18 +107,152 @@ struct sr_rt
     char   interface[sr_IFACE_NAMELEN];
     uint32_t metric;
     time_t updated_time;
+    struct sr_rt_path alt[SR_RT_MAX_PATHS - 1]; /* equal-cost paths besides gw */
+    unsigned int num_alt;
+    struct sr_rt_link link; /* neighbor gw was learned from */
+    struct sr_rt_path backup; /* best longer path, taken when gw is lost */
+    uint32_t backup_metric;
+    unsigned int has_backup;
+    struct sr_rt_damp damp;
+    uint32_t sync_gen; /* sr_rt_sync() pass that last installed it */
+    uint32_t change_seq; /* sr->rt_seq when an advertised field last changed */
+    time_t changed_time; /* when change_seq was last bumped */
     struct sr_rt* next;
+    struct sr_rt* hash_next; /* chain in sr->rt_hash */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rip_digest
+ *
+ * Digest of one of the response packets a neighbor splits its table into,
+ * keyed by the first entry of the packet
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rip_digest
+{
+    uint32_t key_address;
+    uint32_t key_mask;
+    uint64_t digest;       /* of the payload */
+    uint32_t seq;          /* rt_seq right after it was processed, */
+    uint32_t backup_gen;   /* and rt_backup_gen */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rip_nbr
+ *
+ * RIP neighbor, keyed by (source IP, interface). The routes it advertises
+ * live as long as it keeps talking.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rip_nbr
+{
+    uint32_t ip;
+    char interface[sr_IFACE_NAMELEN];
+    uint64_t last_heard_ms; /* sr_now_ms() of its last response */
+    int alive;
+    struct sr_rt** routes; /* routes with a path through it */
+    unsigned int num_routes;
+    unsigned int max_routes;
+    unsigned long updates; /* responses received */
+    struct sr_rip_digest* digests; /* of its last processed packets */
+    unsigned int num_digests;
+    unsigned int max_digests;
+    unsigned long skipped; /* responses identical to the last one */
+    unsigned long denied;  /* entries rejected by the import filter */
+    int over_limit;        /* past its interface's max-prefix */
+    uint64_t shutdown_until_ms; /* ignored until then for exceeding it */
+    unsigned long shutdowns;
+    struct sr_rip_nbr* next;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rip_aggregate
+ *
+ * Range advertised out of an interface in place of the routes it covers
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rip_aggregate
+{
+    char interface[sr_IFACE_NAMELEN];
+    uint32_t dest;
+    uint32_t mask;
+    struct sr_rip_aggregate* next;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rip_import
+ *
+ * Import policy of an interface: a prefix list compiled into a binary trie
+ * on the prefix bits, each node holding the rules for its exact prefix,
+ * and a limit on the routes each neighbor on the interface may install
+ *
+ * -------------------------------------------------------------------------- */
+
+enum sr_rip_max_prefix_action {
+    rip_max_prefix_warn,
+    rip_max_prefix_shutdown
+};
+
+struct sr_rip_filter_rule
+{
+    unsigned int seq;  /* position in the list, the first match wins */
+    int permit;
+    uint8_t ge;        /* prefix lengths it matches */
+    uint8_t le;
+    struct sr_rip_filter_rule* next;
+};
+
+struct sr_rip_filter_node
+{
+    struct sr_rip_filter_node* child[2];
+    struct sr_rip_filter_rule* rules;
+};
+
+struct sr_rip_import
+{
+    char interface[sr_IFACE_NAMELEN];
+    struct sr_rip_filter_node* trie;
+    unsigned int num_rules; /* none - everything is permitted */
+    unsigned int max_prefix; /* paths per neighbor, 0 - no limit */
+    enum sr_rip_max_prefix_action max_prefix_action;
+    unsigned long permitted;
+    unsigned long denied;
+    struct sr_rip_import* next;
+};
+
+struct sr_rt_slab
+{
+    struct sr_rt entries[SR_RT_SLAB_ENTRIES];
+    struct sr_rt_slab* next;
 };
 
+void sr_rt_lock(struct sr_instance* sr);
+void sr_rt_unlock(struct sr_instance* sr);
 int sr_build_rt(struct sr_instance*);
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, uint32_t metric, char*);
+void sr_rt_mark_changed(struct sr_instance* sr, struct sr_rt* entry);
+struct sr_rt* sr_rt_lookup_prefix(struct sr_instance* sr, uint32_t dest, uint32_t mask);
+unsigned int sr_rt_select_path(struct sr_rt* entry, uint32_t hash,
+                               struct in_addr* gw, char** if_name);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
 void *sr_rip_timeout(void *sr_ptr);
 void send_rip_request(struct sr_instance *sr);
 void send_rip_response(struct sr_instance *sr);
+void send_rip_triggered_response(struct sr_instance *sr);
 void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *interface);
+void sr_rip_schedule_trigger(struct sr_instance *sr);
+void sr_rip_trigger_now(struct sr_instance *sr);
+void sr_rip_nbr_down(struct sr_instance *sr, uint32_t ip, const char *if_name);
+void sr_rt_interface_event(struct sr_instance *sr, const char *if_name, uint32_t status);
+void sr_rip_print_stats(struct sr_instance *sr);
+void sr_rt_sync(struct sr_instance *sr, struct sr_rt *routes, unsigned int n);
+int sr_rip_add_aggregates(struct sr_instance *sr, const char *spec);
+int sr_rip_load_imports(struct sr_instance *sr, const char *filename);
 #endif  /* --  sr_RT_H -- */
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <math.h>
 #include "sr_protocol.h"
 #include "sr_utils.h"
 
@@ -30,6 +32,26 @@ uint8_t ip_protocol(uint8_t *buf) {
   return iphdr->ip_p;
 }
 
+/* Milliseconds on the monotonic clock, for timers that must not jump
+   with the wall clock */
+uint64_t sr_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Microseconds on the same clock, for short intervals */
+uint64_t sr_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Exponential decay of value after elapsed_ms */
+uint32_t sr_decay(uint32_t value, uint64_t elapsed_ms, unsigned int half_life_ms) {
+  return (uint32_t)(value * pow(0.5, (double)elapsed_ms / half_life_ms));
+}
+
 
 /* Prints out formatted Ethernet address, e.g. 00:11:22:33:44:55 */
 void print_addr_eth(uint8_t *addr) {
@@ -33,6 +33,10 @@ uint16_t cksum(const void *_data, int len);
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
 
+uint64_t sr_now_ms(void);
+uint64_t sr_now_us(void);
+uint32_t sr_decay(uint32_t value, uint64_t elapsed_ms, unsigned int half_life_ms);
+
 void print_addr_eth(uint8_t *addr);
 void print_addr_ip(struct in_addr address);
 void print_addr_ip_int(uint32_t ip);
@@ -32,6 +32,7 @@
 #include <errno.h>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
@@ -43,6 +44,7 @@
 #include "sr_rt.h"
 #include "sha1.h"
 #include "sr_utils.h"
+#include "sr_pwospf.h"
 #include "vnscommand.h"
 
 static void sr_log_packet(struct sr_instance* , uint8_t* , int );
@@ -350,6 +352,10 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     bytes_read = 0;
 
+    /* No FIB route is held while blocked waiting for the server */
+    if(sr->fib_reader)
+    { sr_fib_offline(sr->fib_reader); }
+
     /* attempt to read the size of the incoming packet */
     while( bytes_read < 4)
     {
@@ -409,6 +415,9 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         } while (errno == EINTR); /* be mindful of signals */
     }
 
+    if(sr->fib_reader)
+    { sr_fib_online(&(sr->fib), sr->fib_reader); }
+
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
     command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
@@ -441,12 +450,16 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                     sizeof(struct sr_ethernet_hdr);
             char* buf2 = (char* )buf+sizeof(c_packet_header);
             if ((packet_length == 2 && strncmp(buf2, "up", 2) == 0) || (packet_length == 4 && strncmp(buf2, "down", 4) == 0)){
-                
-                if (packet_length == 2){
-                    sr_update_interface_status(sr, 1, (char*)(buf + sizeof(c_base)));
-                }
-                else{
-                    sr_update_interface_status(sr, 0, (char*)(buf + sizeof(c_base)));
+                char* if_name = (char*)(buf + sizeof(c_base));
+                uint32_t status = (packet_length == 2) ? 1 : 0;
+
+                /* -- route around the change now, not at the next RIP tick -- */
+                if (sr_obtain_interface_status(sr, if_name) != status){
+                    sr_update_interface_status(sr, status, if_name);
+                    if (sr->routing_protocol == routing_pwospf)
+                        sr_pwospf_interface_event(sr, if_name, status);
+                    else
+                        sr_rt_interface_event(sr, if_name, status);
                 }
                 break;
             }
@@ -496,7 +509,10 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 return -1;
             }
             sr_print_routing_table(sr);
-            send_rip_request(sr);
+            if(sr->routing_protocol == routing_rip)
+            { send_rip_request(sr); }
+            if(sr->arp_warmup)
+            { sr_arp_warmup(sr); }
             printf(" <-- Ready to process packets --> \n");
             break;
 
@@ -632,6 +648,107 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     return 0;
 } /* -- sr_send_packet -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_writev_all(..)
+ * Scope: Local
+ *
+ * writev() the whole iovec array, picking up after short writes.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_writev_all(int fd, struct iovec* iov, int iovcnt)
+{
+    while ( iovcnt > 0 )
+    {
+        ssize_t ret = writev(fd, iov, iovcnt);
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            return -1;
+        }
+        /* -- skip what went out, trim a partially written vector -- */
+        while ( iovcnt > 0 && (size_t)ret >= iov->iov_len )
+        {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if ( iovcnt > 0 )
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return 0;
+} /* -- sr_writev_all -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_batch(..)
+ * Scope: Global
+ *
+ * Send a list of packets (ethernet headers included and already filled in)
+ * out of one interface. The VNS headers are built on the stack and the
+ * frames are sent in place, SR_SEND_BATCH packets per writev(), instead of
+ * one malloc/memcpy/write per packet as in sr_send_packet(..).
+ *
+ * RETURN VALUES:
+ *
+ *  number of packets sent, -1 on a write error
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_SEND_BATCH 64
+
+int sr_send_packet_batch(struct sr_instance* sr /* borrowed */,
+                         struct sr_packet* pkts /* borrowed */,
+                         const char* iface /* borrowed */)
+{
+    c_packet_header hdrs[SR_SEND_BATCH];
+    struct iovec iov[2 * SR_SEND_BATCH];
+    struct sr_packet* pkt;
+    int n = 0, sent = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iface);
+
+    for ( pkt = pkts; pkt; pkt = pkt->next )
+    {
+        /* don't waste my time ... */
+        if ( pkt->len < sizeof(struct sr_ethernet_hdr) ){
+            fprintf(stderr , "** Error: packet is wayy to short \n");
+        }
+        else
+        {
+            memset(&hdrs[n], 0, sizeof(c_packet_header));
+            hdrs[n].mLen  = htonl(pkt->len + sizeof(c_packet_header));
+            hdrs[n].mType = htonl(VNSPACKET);
+            strncpy(hdrs[n].mInterfaceName,iface,16);
+            iov[2*n].iov_base   = &hdrs[n];
+            iov[2*n].iov_len    = sizeof(c_packet_header);
+            iov[2*n+1].iov_base = pkt->buf;
+            iov[2*n+1].iov_len  = pkt->len;
+
+            /* -- log packet -- */
+            sr_log_packet(sr,pkt->buf,pkt->len);
+            n++;
+        }
+
+        if ( n == SR_SEND_BATCH || (pkt->next == 0 && n > 0) )
+        {
+            if ( sr_writev_all(sr->sockfd, iov, 2*n) < 0 ){
+                fprintf(stderr, "Error writing packet batch\n");
+                return -1;
+            }
+            sent += n;
+            n = 0;
+        }
+    }
+
+    return sent;
+} /* -- sr_send_packet_batch -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
  * Scope: Local